@@ -0,0 +1,48 @@
+/*
+ * boot.h
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BOOT_H__
+#define __BOOT_H__
+
+#include <sys/types.h>
+
+enum boot_event {
+    BOOT_EV_MAIN = 0,
+    BOOT_EV_LOOP,
+    BOOT_EV_USB_MOUNTED,
+    BOOT_EV_DISK_FORMATTED,
+    BOOT_EV_DISK_READY,
+    BOOT_EV_SENSOR_START,
+    BOOT_EV_SENSOR_READY,
+    BOOT_EV_DONE,
+    BOOT_EV_COUNT
+};
+
+// only the first occurence of each event is recorded
+void boot_mark(enum boot_event ev);
+
+// runs next disk boot step on core 0, returns true when booting is finished
+bool boot_run(void);
+
+// runs next sensor boot step on core 1, returns true when the sensor is done
+bool boot_sensor_run(void);
+bool boot_sensor_ok(void);
+
+void boot_print_timeline(char *buff, size_t len);
+
+#endif // __BOOT_H__
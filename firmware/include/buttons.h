@@ -19,8 +19,47 @@
 #ifndef __BUTTONS_H__
 #define __BUTTONS_H__
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define BUTTONS_COUNT 4
+
+#define BUTTON_BOUNCE_BUCKETS 8
+
+// switch wear statistics, persisted in the settings
+struct button_wear {
+    uint32_t presses;
+    uint32_t changes; // reported presses and releases
+    uint32_t edges; // all edges, everything but the changes was bounce
+    uint32_t bounce_max_us;
+    uint32_t bounce_recent_us; // moving average
+    uint32_t bounce_hist[BUTTON_BOUNCE_BUCKETS]; // up to DEBOUNCE_DELAY_MS
+};
+
+enum button_debounce {
+    BUTTON_DEBOUNCE_DEFERRED = 0, // report once stable for DEBOUNCE_DELAY_MS
+    BUTTON_DEBOUNCE_EAGER, // report first edge, then hold off for DEBOUNCE_DELAY_MS
+};
+
+/*
+ * Button edges are timestamped in the GPIO interrupt and
+ * debounced from those timestamps in buttons_run().
+ * Both have to be called on the same core.
+ */
 void buttons_init(void);
-void buttons_run(void);
+
+// returns time of the next pending debounce decision, 0 when idle
+uint64_t buttons_run(void);
+
+enum button_debounce buttons_get_debounce(int id);
+void buttons_set_debounce(int id, enum button_debounce mode); // persists
+
+// stores wear statistics on suspend, every few hours or presses, core 0 only
+void buttons_wear_run(void);
+void buttons_wear_set_suspended(bool suspended);
+void buttons_wear_reset(void); // core of buttons_run() only
+size_t buttons_wear_print(char *buff, size_t len);
 
 #endif // __BUTTONS_H__
 
@@ -23,20 +23,38 @@
 
 #define PMW_PRINT_IDS
 #define PMW_IRQ_COUNTERS
-//#define PMW_FEATURE_WIRELESS
+#define PMW_HEALTH_QUIET_MS 1000
+#define PMW_MOTION_MIN_INTERVAL_US 1000
+#define DEFAULT_PMW_PROFILE PMW_PROFILE_COMPETITIVE
 //#define DISABLE_CDC_DTR_CHECK
+//#define MAIN_LOOP_PROFILER
 
 #define INVERT_MOUSE_X_AXIS false
 #define INVERT_MOUSE_Y_AXIS true
 #define DEFAULT_MOUSE_SENSITIVITY PMW_CPI_TO_SENSE(500)
 #define DEFAULT_MOUSE_ANGLE -30
+#define DEFAULT_MOUSE_REPORT HID_MOUSE_REPORT_16BIT
+#define DEFAULT_HID_INTERVAL_MS 1
 
 #define INVERT_SCROLL_X_AXIS false
 #define INVERT_SCROLL_Y_AXIS false
 #define SCROLL_REDUCE_SENSITIVITY 20
-#define MIN_SCROLL_SUPPRESS_CLICK 10
-#define MOUSE_FAKE_MIDDLE_CLICK_TIME 10
+
+// releasing scroll-lock within the tap time (0 for no limit), after
+// moving less than the threshold, sends a middle click of hold time.
+// threshold is in sensor counts at 1000cpi, scaled to the current cpi
+#define MOUSE_FAKE_MIDDLE_TAP_MS 1000
+#define MOUSE_FAKE_MIDDLE_HOLD_MS 10
+#define MOUSE_FAKE_MIDDLE_MOVE_COUNTS 20
 
 #define DEBOUNCE_DELAY_MS 5
 
+// bitmask of buttons reporting the first edge, then ignoring
+// further edges for DEBOUNCE_DELAY_MS, instead of waiting until stable
+#define DEFAULT_BUTTON_DEBOUNCE_EAGER 0x00
+
+// scan and debounce the buttons with PIO instead of GPIO interrupts.
+// always debounces eagerly then, and records no bounce statistics
+//#define BUTTONS_PIO
+
 #endif // __CONFIG_H__
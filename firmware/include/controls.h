@@ -19,6 +19,12 @@
 #ifndef __CONTROLS_H__
 #define __CONTROLS_H__
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "buttons.h"
+
 enum mouse_buttons {
     MOUSE_LEFT = 0,
     MOUSE_MIDDLE,
@@ -28,19 +34,69 @@ enum mouse_buttons {
     MOUSE_BUTTONS_COUNT
 };
 
+#define BUTTON_LAYERS 4
+
+enum button_action_type {
+    ACTION_NONE = 0, // same as on layer 0
+    ACTION_MOUSE, // arg: enum mouse_buttons
+    ACTION_SCROLL_LOCK,
+    ACTION_CPI, // arg: sensitivity register value
+    ACTION_KEY, // arg: HID keycode, mod: HID modifier bits
+    ACTION_LAYER, // arg: layer, while held, highest held layer wins
+    ACTION_DISABLED, // does nothing, not even what it does on layer 0
+
+    ACTION_COUNT
+};
+
+struct button_action {
+    uint8_t type; // enum button_action_type
+    uint8_t arg;
+    uint8_t mod;
+};
+
+// persisted in the settings, indexed by layer and button
+#define CONTROLS_DEFAULT_KEYMAP {                                       \
+    [0] = {                                                             \
+        [0] = { .type = ACTION_MOUSE, .arg = MOUSE_BACK, .mod = 0 },    \
+        [1] = { .type = ACTION_SCROLL_LOCK, .arg = 0, .mod = 0 },       \
+        [2] = { .type = ACTION_MOUSE, .arg = MOUSE_LEFT, .mod = 0 },    \
+        [3] = { .type = ACTION_MOUSE, .arg = MOUSE_RIGHT, .mod = 0 },   \
+    },                                                                  \
+}
+
+// range of one HID mouse report axis
+#define MOUSE_DELTA_MAX_8BIT 127
+#define MOUSE_DELTA_MAX_16BIT 32767
+
 struct mouse_state {
-    bool changed;
+    bool changed; // mouse report has to be sent
+    bool keys_changed; // keyboard report has to be sent
     bool button[MOUSE_BUTTONS_COUNT];
     int16_t delta_x, delta_y;
     int16_t scroll_x, scroll_y;
     bool scroll_lock;
-    uint16_t fake_middle;
-    int16_t internal_scroll_x, internal_scroll_y;
+    uint8_t key_modifier;
+    uint8_t keycode[6];
+    int32_t internal_scroll_x, internal_scroll_y;
+    uint16_t samples; // sensor samples in this report
+    uint64_t sample_time; // timestamp of newest sample
+    uint64_t sample_time_oldest; // timestamp of oldest sample
 };
 
 void controls_init(void);
 
-void controls_mouse_new(int id, bool state);
+void controls_set_delta_max(int32_t max);
+
+// time of the button edge, from time_us_32()
+void controls_mouse_new(int id, bool state, uint32_t time);
+
+// actions are parsed from and printed as eg. "mouse forward", "key 0x06 0x01"
+int controls_action_parse(const char *s, struct button_action *action);
+size_t controls_keymap_print(char *buff, size_t len);
+
+// core 1 only, caller has to save the settings
+int controls_set_action(int layer, int id, struct button_action action);
+void controls_keymap_reset(void);
 struct mouse_state controls_mouse_read(void);
 
 #endif // __CONTROLS_H__
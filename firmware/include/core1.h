@@ -0,0 +1,64 @@
+/*
+ * core1.h
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CORE1_H__
+#define __CORE1_H__
+
+#include <stdbool.h>
+#include "controls.h"
+
+/*
+ * Core 1 owns the sensor (SPI, DMA and MOTION interrupts),
+ * the buttons and building of mouse reports.
+ * Core 0 keeps USB, console, log, FatFS and mass storage.
+ *
+ * Requests go to core 1 through a ring buffer, because its FIFO
+ * is used by the multicore lockout for flash writes. Finished
+ * calls are signalled back through the FIFO of core 0.
+ */
+void core1_init(void);
+void core1_run(void); // core 0 main loop
+
+// core 0 stops feeding the watchdog when core 1 hangs
+bool core1_alive(void);
+
+// run fn(arg) on core 1 and wait for it to finish, only for short calls
+void core1_call(void (*fn)(void *arg), void *arg);
+
+/*
+ * Longer work is split into steps, run on core 1 in between
+ * building reports. start() returns < 0 to refuse the job,
+ * run() returns 1 while in progress, then the result.
+ * Only one job at a time, finished jobs come back through
+ * core1_job_done(), which core 0 has to poll.
+ */
+struct core1_job {
+    int (*start)(void *arg);
+    int (*run)(void *arg);
+    void *arg;
+    int result;
+};
+
+bool core1_job_start(struct core1_job *job); // false if refused or busy
+struct core1_job *core1_job_done(void); // NULL while none is finished
+
+// ask core 1 for a new mouse report, fetched with core1_get_report()
+bool core1_request_report(void);
+bool core1_get_report(struct mouse_state *mouse);
+
+#endif // __CORE1_H__
@@ -0,0 +1,60 @@
+/*
+ * debounce.h
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DEBOUNCE_H__
+#define __DEBOUNCE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "buttons.h"
+
+/*
+ * Debounce state of one button, driven only by edge timestamps.
+ * Does not touch any hardware, so it can be tested on the host.
+ */
+struct debounce {
+    uint32_t first_edge, last_edge; // of the current transition
+    bool current; // reported level
+    bool last; // level after the last edge
+    bool settling; // edges since the last decision
+    bool holdoff;
+    uint32_t holdoff_start;
+};
+
+enum debounce_result {
+    DEBOUNCE_UNCHANGED = 0, // same level as before
+    DEBOUNCE_BOUNCING, // level changed, decided later
+    DEBOUNCE_REPORT, // current changed and has to be reported
+};
+
+// take a stable level, eg. at boot or debounced by PIO
+void debounce_init(struct debounce *d, bool state, uint32_t now);
+
+enum debounce_result debounce_edge(struct debounce *d, enum button_debounce mode,
+                                   bool state, uint32_t time);
+
+/*
+ * Decides pending transitions. Returns microseconds until it has to
+ * be called again, UINT32_MAX when idle. Sets bounce to the length of
+ * a finished transition, or UINT32_MAX.
+ */
+uint32_t debounce_poll(struct debounce *d, enum button_debounce mode, uint32_t now,
+                       enum debounce_result *result, uint32_t *bounce);
+
+#endif // __DEBOUNCE_H__
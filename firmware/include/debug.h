@@ -19,10 +19,15 @@
 #ifndef __DEBUG_H__
 #define __DEBUG_H__
 
+#include <stdint.h>
+#include <sys/types.h>
+
 int debug_msc_mount(void);
 int debug_msc_unmount(void);
 
 void debug_msc_stats(void);
-void debug_msc_pmw3360(void);
+
+// writes captures of pmw_dump_run() and pmw_frame_capture_run()
+void debug_msc_pmw3360(size_t samples, const uint8_t *frame, ssize_t frame_len);
 
 #endif // __DEBUG_H__
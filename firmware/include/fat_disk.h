@@ -19,6 +19,7 @@
 #define DISK_BLOCK_COUNT 256
 #define DISK_BLOCK_SIZE 512
 
-void fat_disk_init(void);
+int fat_disk_format(void);
+void fat_disk_populate(void);
 
 uint8_t *fat_disk_get_sector(uint32_t sector);
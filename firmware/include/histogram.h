@@ -0,0 +1,62 @@
+/*
+ * histogram.h
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HISTOGRAM_BUCKETS 32
+
+/*
+ * Fixed-width buckets, the last one also collects everything above.
+ * Cheap enough to be updated from interrupt context.
+ */
+struct histogram {
+    const char *name;
+    const char *unit;
+    uint32_t bucket_width;
+    uint32_t buckets[HISTOGRAM_BUCKETS];
+    uint32_t count;
+    uint32_t min, max;
+    uint64_t sum;
+};
+
+#define HISTOGRAM_INIT_UNIT(n, width, u) { \
+    .name = (n),                           \
+    .unit = (u),                           \
+    .bucket_width = (width),               \
+    .buckets = { 0 },                      \
+    .count = 0,                            \
+    .min = UINT32_MAX,                     \
+    .max = 0,                              \
+    .sum = 0,                              \
+}
+
+#define HISTOGRAM_INIT(n, width) HISTOGRAM_INIT_UNIT(n, width, "us")
+
+void histogram_add(struct histogram *h, uint32_t value);
+void histogram_reset(struct histogram *h);
+
+// upper bucket edge below which pct percent of values are
+uint32_t histogram_percentile(const struct histogram *h, uint32_t pct);
+
+size_t histogram_print(const struct histogram *h, char *buff, size_t len);
+
+#endif // __HISTOGRAM_H__
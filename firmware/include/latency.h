@@ -0,0 +1,42 @@
+/*
+ * latency.h
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Stages of the motion to USB path,
+ * each measured from the MOTION interrupt of the sample.
+ */
+enum latency_stage {
+    LAT_BURST_DONE = 0,
+    LAT_CONTROLS_READ,
+    LAT_REPORT_QUEUED,
+    LAT_REPORT_COMPLETE,
+
+    LAT_STAGE_COUNT
+};
+
+void latency_add(enum latency_stage stage, uint64_t irq_time_us);
+void latency_reset(void);
+size_t latency_print(char *buff, size_t len);
+
+#endif // __LATENCY_H__
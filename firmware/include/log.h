@@ -34,6 +34,9 @@
 void debug_log(bool log, const char *format, ...) __attribute__((format(printf, 2, 3)));
 void debug_wait_input(const char *format, ...) __attribute__((format(printf, 1, 2)));
 
+// hands output from core 1 to USB, core 0 only
+void log_run(void);
+
 void log_dump_to_usb(void);
 void log_dump_to_disk(void);
 
@@ -21,17 +21,26 @@
 
 #include <sys/types.h>
 
-struct pmw_motion {
-    bool motion;
+struct pmw_sample {
+    uint64_t time_us; // timestamp of MOTION interrupt
     int32_t delta_x;
     int32_t delta_y;
+    uint8_t motion;
+    uint8_t observation;
+    uint8_t squal;
 };
 
 int pmw_init(void);
+
+// incremental initialization, pmw_init_run() returns 1 while in progress
+void pmw_init_start(void);
+int pmw_init_run(void);
+
 void pmw_run(void);
 bool pmw_is_alive(void);
 
-struct pmw_motion pmw_get(void);
+// fetch oldest motion sample, returns false when there is none
+bool pmw_get_sample(struct pmw_sample *sample);
 
 /*
  * 0x00: 100 cpi (minimum cpi)
@@ -44,6 +53,7 @@ struct pmw_motion pmw_get(void);
  */
 void pmw_set_sensitivity(uint8_t sens);
 uint8_t pmw_get_sensitivity(void);
+uint16_t pmw_get_cpi(void); // last value set, without bus access
 #define PMW_SENSE_TO_CPI(sense) (100 + (sense * 100))
 #define PMW_CPI_TO_SENSE(cpi) ((cpi / 100) - 1)
 
@@ -51,9 +61,27 @@ void pmw_set_angle(int8_t angle);
 int8_t pmw_get_angle(void);
 
 void pmw_print_status(char *buff, size_t len);
-void pmw_dump_data(bool serial);
 
-ssize_t pmw_frame_capture(uint8_t *buff, size_t buffsize);
+/*
+ * Debug captures run in the background, pmw_*_start() returns < 0
+ * while the sensor is busy, pmw_*_run() returns 1 while in progress.
+ * The dump records motion bursts while tracking goes on, and
+ * finishes with the number of samples after PMW_DATA_DUMP_SAMPLES
+ * or a timeout. Its CSV can be printed on any core afterwards,
+ * line 0 is the header.
+ */
+int pmw_dump_start(void);
+int pmw_dump_run(void);
+size_t pmw_dump_print(size_t line, char *buff, size_t len);
+#define PMW_DATA_DUMP_SAMPLES 1000
+
+// stops tracking and re-initializes afterwards, returns the length when done
+int pmw_frame_capture_start(uint8_t *buff, size_t buffsize);
+ssize_t pmw_frame_capture_run(void);
 #define PMW_FRAME_CAPTURE_LEN 1296
 
+// full power-up of the sensor, returns 0 when done
+int pmw_reinit_start(void);
+int pmw_reinit_run(void);
+
 #endif // __PMW3360_H__
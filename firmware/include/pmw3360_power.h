@@ -0,0 +1,62 @@
+/*
+ * pmw3360_power.h
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PMW3360_POWER_H__
+#define __PMW3360_POWER_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Power / latency profiles for the rest mode state machine.
+ * The sensor downshifts from Run to Rest1, Rest2 and Rest3 when
+ * there is no motion, trading wake-up latency for supply current.
+ */
+enum pmw_profile {
+    PMW_PROFILE_COMPETITIVE = 0, // rest modes disabled, always in Run
+    PMW_PROFILE_BALANCED, // datasheet default rest timing
+    PMW_PROFILE_IDLE_SAVER, // downshift quickly, long rest frame periods
+
+    PMW_PROFILE_COUNT
+};
+
+enum pmw_op_mode {
+    PMW_MODE_RUN = 0,
+    PMW_MODE_REST1,
+    PMW_MODE_REST2,
+    PMW_MODE_REST3,
+
+    PMW_MODE_COUNT
+};
+
+const char *pmw_profile_name(enum pmw_profile profile);
+int pmw_profile_from_name(const char *name); // -1 if unknown
+
+// program the rest mode registers, called during sensor configuration
+void pmw_power_apply(enum pmw_profile profile);
+enum pmw_profile pmw_power_get_profile(void);
+
+// select and apply a profile, stored with the next settings_save()
+void pmw_power_set_profile(enum pmw_profile profile);
+
+// called for every motion report, from interrupt context
+void pmw_power_sample(uint8_t motion, uint64_t time_us);
+
+size_t pmw_power_print_status(char *buff, size_t len);
+
+#endif // __PMW3360_POWER_H__
@@ -76,6 +76,8 @@
 #define REG_MOTION_OP_1 1
 #define REG_MOTION_OP_2 2
 
+#define REG_OBSERVATION_SROM_RUN 6
+
 struct pmw_motion_report {
     uint8_t motion;
     uint8_t observation;
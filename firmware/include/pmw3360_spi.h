@@ -0,0 +1,90 @@
+/*
+ * pmw3360_spi.h
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PMW3360_SPI_H__
+#define __PMW3360_SPI_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+enum pmw_op_type {
+    PMW_OP_READ = 0,
+    PMW_OP_WRITE,
+    PMW_OP_MOTION_BURST,
+};
+
+struct pmw_op;
+
+// called from interrupt context when the operation is complete
+typedef void (*pmw_op_callback_t)(struct pmw_op *op);
+
+struct pmw_op {
+    enum pmw_op_type type;
+    uint8_t reg;
+    uint8_t data; // value to write, or value read back
+    uint8_t *buff; // destination of motion burst report
+    volatile bool done;
+    pmw_op_callback_t callback;
+    void *user;
+};
+
+struct pmw_spi_stats {
+    uint64_t ops; // operations started
+    uint64_t rearm; // Motion_Burst register writes
+    uint32_t max_queue; // highest number of queued operations
+};
+
+void pmw_spi_init(void);
+struct pmw_spi_stats pmw_spi_get_stats(void);
+
+/*
+ * Asynchronous register access.
+ * Operations are executed in order, the required delays
+ * between them are paced by a hardware alarm.
+ * The op struct must stay valid until op->done is set.
+ */
+bool pmw_spi_submit(struct pmw_op *op); // false if queue is full
+void pmw_spi_queue(struct pmw_op *op); // spins until queued
+void pmw_spi_wait(struct pmw_op *op);
+bool pmw_spi_idle(void);
+void pmw_spi_wait_idle(void);
+
+// blocking wrappers around the asynchronous operations
+void pmw_write_register(uint8_t reg, uint8_t data);
+uint8_t pmw_read_register(uint8_t reg);
+void pmw_read_motion_burst(uint8_t *buff);
+
+/*
+ * Direct bus access, bypassing the operation queue.
+ * Waits for the current operation, then holds the bus.
+ * Operations submitted meanwhile are started afterwards.
+ */
+void pmw_cs_select(void);
+void pmw_cs_deselect(void);
+void pmw_write_register_burst(uint8_t reg, const uint8_t *buf, uint16_t len);
+void pmw_write_register_burst_start(uint8_t reg, const uint8_t *buf, uint16_t len);
+bool pmw_write_register_burst_busy(void);
+void pmw_write_register_burst_finish(void);
+void pmw_read_register_burst(uint8_t reg, uint8_t *buf, uint16_t len);
+
+// long read bursts can be split, the bus stays held until finished
+void pmw_read_register_burst_start(uint8_t reg);
+void pmw_read_register_burst_continue(uint8_t *buf, uint16_t len);
+void pmw_read_register_burst_finish(void);
+
+#endif // __PMW3360_SPI_H__
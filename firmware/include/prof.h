@@ -0,0 +1,77 @@
+/*
+ * prof.h
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PROF_H__
+#define __PROF_H__
+
+#include <stddef.h>
+#include "config.h"
+
+#ifdef MAIN_LOOP_PROFILER
+
+#include "pico/stdlib.h"
+#include "hardware/structs/systick.h"
+
+enum prof_task {
+    // core 0
+    PROF_WATCHDOG = 0,
+    PROF_HEARTBEAT,
+    PROF_USB,
+    PROF_WORK,
+    PROF_LOG,
+    PROF_CONSOLE,
+    PROF_BOOT,
+    PROF_BUTTON_WEAR,
+
+    // core 1
+    PROF_CORE1_REQUESTS,
+    PROF_BUTTONS,
+    PROF_PMW,
+    PROF_CORE1_JOB,
+
+    PROF_TASK_COUNT
+};
+
+/*
+ * Execution time of one main loop task, in clk_sys cycles.
+ * Counted with the SysTick of the calling core, the microsecond
+ * timer is only used for tasks longer than its 24 bit range.
+ */
+#define PROF_RUN(task, call) do {                   \
+    uint32_t prof_start = systick_hw->cvr;          \
+    uint32_t prof_start_us = time_us_32();          \
+    call;                                           \
+    prof_add((task), prof_start, prof_start_us);    \
+} while (0)
+
+// start of a main loop iteration, on the calling core
+#define PROF_LOOP() prof_loop()
+
+void prof_add(enum prof_task task, uint32_t start_cycles, uint32_t start_us);
+void prof_loop(void);
+void prof_reset(void);
+void prof_print(char *buff, size_t len);
+
+#else // MAIN_LOOP_PROFILER
+
+#define PROF_RUN(task, call) call
+#define PROF_LOOP() do { } while (0)
+
+#endif // MAIN_LOOP_PROFILER
+
+#endif // __PROF_H__
@@ -0,0 +1,51 @@
+/*
+ * ring.h
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RING_H__
+#define __RING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Lock-free ring buffer for exactly one producer and one consumer,
+ * eg. an interrupt handler and the main loop, or two cores.
+ * One element is always kept free to tell full and empty apart.
+ */
+struct ring_buffer {
+    uint8_t *buffer;
+    size_t element_size;
+    size_t size;
+    volatile size_t head, tail;
+};
+
+#define RB_INIT(buff, len, el_size) { \
+    .buffer = (uint8_t *)(buff),      \
+    .element_size = (el_size),        \
+    .size = (len),                    \
+    .head = 0,                        \
+    .tail = 0,                        \
+}
+
+bool rb_push(struct ring_buffer *rb, const void *data); // producer only
+bool rb_pop(struct ring_buffer *rb, void *data); // consumer only
+size_t rb_len(const struct ring_buffer *rb);
+bool rb_full(const struct ring_buffer *rb); // stays true until the consumer pops
+
+#endif // __RING_H__
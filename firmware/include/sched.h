@@ -0,0 +1,72 @@
+/*
+ * sched.h
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "prof.h"
+
+/*
+ * Cooperative tickless scheduler, one task list per core.
+ * Tasks with a period run when their deadline is due, tasks with
+ * every_pass set also run after each wake-up, which is how event
+ * sources (interrupts, other core) are handled. Tasks without a
+ * period can request a single deadline with sched_wake_at(). When nothing is
+ * due the core sleeps in WFE until the next deadline, an interrupt
+ * or an event sent by the other core with sched_wake().
+ */
+struct sched_task {
+    void (*run)(void);
+    uint32_t period_us; // 0 for no deadline
+    bool every_pass;
+#ifdef MAIN_LOOP_PROFILER
+    enum prof_task prof;
+#endif // MAIN_LOOP_PROFILER
+    uint64_t next; // 0 for no deadline
+};
+
+#ifdef MAIN_LOOP_PROFILER
+#define SCHED_TASK_PROF(p) .prof = (p),
+#else // MAIN_LOOP_PROFILER
+#define SCHED_TASK_PROF(p)
+#endif // MAIN_LOOP_PROFILER
+
+#define SCHED_TASK(fn, period, every, p) { \
+    .run = (fn),                           \
+    .period_us = (period),                 \
+    .every_pass = (every),                 \
+    SCHED_TASK_PROF(p)                     \
+    .next = 0,                             \
+}
+
+void sched_loop(struct sched_task *tasks, size_t count) __attribute__((noreturn));
+
+// wakes up both cores, safe from any context
+void sched_wake(void);
+
+// one-shot deadline for a task without period, 0 to cancel. owning core only
+void sched_wake_at(struct sched_task *task, uint64_t time_us);
+
+void sched_reset(void);
+size_t sched_print(char *buff, size_t len);
+
+#endif // __SCHED_H__
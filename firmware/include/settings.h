@@ -0,0 +1,46 @@
+/*
+ * settings.h
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SETTINGS_H__
+#define __SETTINGS_H__
+
+#include <stdint.h>
+#include "buttons.h"
+#include "controls.h"
+
+/*
+ * Persistent settings, stored in the last sector of the flash.
+ * Bump SETTINGS_VERSION in settings.c when changing this struct,
+ * old contents are then replaced with the defaults.
+ */
+struct settings {
+    uint8_t pmw_profile; // enum pmw_profile
+    uint8_t mouse_report; // enum hid_mouse_report
+    uint8_t hid_interval_ms;
+    uint8_t button_debounce_eager; // bitmask of buttons
+    struct button_wear button_wear[BUTTONS_COUNT];
+    struct button_action keymap[BUTTON_LAYERS][BUTTONS_COUNT];
+};
+
+void settings_init(void);
+struct settings *settings_get(void);
+
+// writes to flash, only when something changed
+int settings_save(void);
+
+#endif // __SETTINGS_H__
@@ -22,4 +22,7 @@
 void usb_init(void);
 void usb_run(void);
 
+// disconnect from the host and enumerate again
+void usb_reconnect(void);
+
 #endif // __USB_H__
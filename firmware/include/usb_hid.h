@@ -24,6 +24,25 @@ struct usb_hid_mouse {
     int32_t delta_y;
 };
 
+enum hid_mouse_report {
+    HID_MOUSE_REPORT_8BIT = 0, // boot mouse compatible
+    HID_MOUSE_REPORT_16BIT,
+
+    HID_MOUSE_REPORT_COUNT
+};
+
+void usb_hid_init(void);
+enum hid_mouse_report usb_hid_get_mouse_report(void);
+
+// persists the format and re-enumerates with the new descriptor
+void usb_hid_set_mouse_report(enum hid_mouse_report report);
+
+// polling interval in ms, 1, 2, 4 or 8 (1000, 500, 250 or 125Hz)
+uint8_t usb_hid_get_interval(void);
+int usb_hid_set_interval(uint8_t interval_ms); // persists and re-enumerates
+
+void usb_hid_print_status(char *buff, size_t len);
+
 void hid_task(void);
 
 #endif // __USB_HID_H__
@@ -19,8 +19,10 @@
 #ifndef __UTIL_H__
 #define __UTIL_H__
 
+#define HEARTBEAT_INTERVAL_MS 500
+
 void heartbeat_init(void);
-void heartbeat_run(void);
+void heartbeat_run(void); // toggles LED, call every HEARTBEAT_INTERVAL_MS
 
 int32_t convert_two_complement(int32_t b);
 
@@ -0,0 +1,44 @@
+/*
+ * work.h
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WORK_H__
+#define __WORK_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Deferred work, posted from interrupt handlers or USB callbacks
+ * and executed from the main loop. Work items are statically
+ * allocated, posting an item that is already queued does nothing.
+ */
+struct work;
+typedef void (*work_fn_t)(struct work *work);
+
+struct work {
+    work_fn_t fn;
+    volatile bool queued;
+};
+
+#define WORK_INIT(f) { .fn = (f), .queued = false }
+
+void work_init(void);
+bool work_post(struct work *work); // safe from any context
+void work_run(void); // main loop only
+
+#endif // __WORK_H__
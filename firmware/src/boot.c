@@ -0,0 +1,147 @@
+/*
+ * boot.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+
+#include "config.h"
+#include "log.h"
+#include "fat_disk.h"
+#include "pmw3360.h"
+#include "boot.h"
+
+enum boot_state {
+    BOOT_DISK_FORMAT = 0,
+    BOOT_DISK_FILES,
+    BOOT_DISK_DONE,
+    BOOT_DONE,
+};
+
+enum boot_sensor_state {
+    BOOT_SENSOR_START = 0,
+    BOOT_SENSOR,
+    BOOT_SENSOR_DONE,
+};
+
+static const char *boot_event_names[BOOT_EV_COUNT] = {
+    "main",
+    "main loop",
+    "usb mounted",
+    "disk formatted",
+    "disk ready",
+    "sensor start",
+    "sensor ready",
+    "boot done",
+};
+
+static uint64_t boot_timeline[BOOT_EV_COUNT] = { 0 };
+static enum boot_state state = BOOT_DISK_FORMAT;
+static volatile enum boot_sensor_state sensor_state = BOOT_SENSOR_START;
+static volatile bool sensor_ok = false;
+
+void boot_mark(enum boot_event ev) {
+    if ((ev < BOOT_EV_COUNT) && (boot_timeline[ev] == 0)) {
+        boot_timeline[ev] = to_us_since_boot(get_absolute_time());
+    }
+}
+
+bool boot_run(void) {
+    switch (state) {
+    case BOOT_DISK_FORMAT:
+        boot_mark(BOOT_EV_LOOP);
+        if (fat_disk_format() == 0) {
+            boot_mark(BOOT_EV_DISK_FORMATTED);
+            state = BOOT_DISK_FILES;
+        } else {
+            state = BOOT_DISK_DONE;
+        }
+        break;
+
+    case BOOT_DISK_FILES:
+        fat_disk_populate();
+        boot_mark(BOOT_EV_DISK_READY);
+        state = BOOT_DISK_DONE;
+        break;
+
+    case BOOT_DISK_DONE:
+        if (sensor_state != BOOT_SENSOR_DONE) {
+            break;
+        }
+
+        boot_mark(BOOT_EV_DONE);
+        debug("init done after %llums", boot_timeline[BOOT_EV_DONE] / 1000);
+        state = BOOT_DONE;
+        break;
+
+    case BOOT_DONE:
+        return true;
+    }
+
+    return false;
+}
+
+bool boot_sensor_run(void) {
+    switch (sensor_state) {
+    case BOOT_SENSOR_START:
+        boot_mark(BOOT_EV_SENSOR_START);
+        pmw_init_start();
+        sensor_state = BOOT_SENSOR;
+        break;
+
+    case BOOT_SENSOR:
+    {
+        int r = pmw_init_run();
+        if (r > 0) {
+            break;
+        }
+
+        if (r == 0) {
+            boot_mark(BOOT_EV_SENSOR_READY);
+            sensor_ok = true;
+        } else {
+            debug("error initializing PMW3360");
+        }
+
+        sensor_state = BOOT_SENSOR_DONE;
+    }
+        break;
+
+    case BOOT_SENSOR_DONE:
+        return true;
+    }
+
+    return false;
+}
+
+bool boot_sensor_ok(void) {
+    return sensor_ok;
+}
+
+void boot_print_timeline(char *buff, size_t len) {
+    size_t pos = 0;
+
+    pos += snprintf(buff + pos, len - pos, "Boot timeline:\r\n");
+    for (int i = 0; i < BOOT_EV_COUNT; i++) {
+        if (boot_timeline[i] == 0) {
+            pos += snprintf(buff + pos, len - pos, "%16s: -\r\n", boot_event_names[i]);
+        } else {
+            pos += snprintf(buff + pos, len - pos, "%16s: %llu.%03llums\r\n", boot_event_names[i],
+                    boot_timeline[i] / 1000, boot_timeline[i] % 1000);
+        }
+    }
+}
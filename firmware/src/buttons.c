@@ -16,51 +16,405 @@
  * See <http://www.gnu.org/licenses/>.
  */
 
+#include <stdio.h>
+#include <string.h>
 #include "pico/stdlib.h"
-
 #include "config.h"
+
+#ifdef BUTTONS_PIO
+#include "hardware/pio.h"
+#include "hardware/clocks.h"
+#include "buttons.pio.h"
+#endif // BUTTONS_PIO
+
+#include "log.h"
+#include "ring.h"
+#include "settings.h"
 #include "controls.h"
+#include "debounce.h"
 #include "buttons.h"
 
-#define BUTTONS_COUNT 4
+#define BUTTON_EVENTS 32
+#define BUTTON_EDGES (GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE)
+#define DEBOUNCE_DELAY_US (DEBOUNCE_DELAY_MS * 1000)
+
+#define BUTTON_BOUNCE_BUCKET_US (DEBOUNCE_DELAY_US / BUTTON_BOUNCE_BUCKETS)
+#define BUTTON_WEAR_AVERAGE 16 // presses in moving average
+#define BUTTON_WEAR_WARN_PERCENT 50 // of DEBOUNCE_DELAY_MS
+#define BUTTON_WEAR_WORN_PERCENT 80
+
+// flash writes stall both cores and wear the flash, so store while the
+// host has suspended the bus, otherwise at most every few hours or after
+// many presses, and only when idle. That is below 20 writes a day even
+// for heavy use, the flash sector lasts 100k.
+#define BUTTON_WEAR_IDLE_MS (5 * 1000)
+#define BUTTON_WEAR_SAVE_INTERVAL_MS (4 * 60 * 60 * 1000)
+#define BUTTON_WEAR_SAVE_PRESSES 1000
+
+#ifdef BUTTONS_PIO
+#define BUTTON_PIO pio0
+#define BUTTON_PIO_IRQ PIO0_IRQ_0
+#define BUTTON_PIO_GROUPS 4 // one state machine each
+#endif // BUTTONS_PIO
+
 uint gpio_num[BUTTONS_COUNT] = { 21, 22, 26, 27 };
 
+struct button_event {
+    uint32_t time;
+    uint8_t id;
+    bool state;
+};
+
 struct button_state {
-    uint32_t last_time;
-    bool current_state, last_state;
+    struct debounce db;
+    volatile uint8_t debounce; // enum button_debounce
 };
 
 struct button_state buttons[BUTTONS_COUNT];
 
+static struct button_event event_buff[BUTTON_EVENTS];
+static struct ring_buffer event_ring = RB_INIT(event_buff, BUTTON_EVENTS, sizeof(struct button_event));
+static volatile bool event_overflow = false;
+
+static volatile bool wear_dirty = false;
+static volatile uint32_t last_activity_ms = 0;
+static volatile bool wear_suspended = false;
+static volatile uint32_t wear_presses = 0; // since the last store
+static uint32_t last_wear_save_ms = 0;
+static bool wear_warned[BUTTONS_COUNT];
+
+#ifdef BUTTONS_PIO
+// consecutive pins are scanned by the same state machine
+struct button_group {
+    uint sm;
+    uint first; // index in gpio_num
+    uint count;
+};
+
+static struct button_group groups[BUTTON_PIO_GROUPS];
+static uint group_count = 0;
+#endif // BUTTONS_PIO
+
+static const char *buttons_wear_state(const struct button_wear *wear) {
+    if (wear->bounce_recent_us >= (DEBOUNCE_DELAY_US * BUTTON_WEAR_WORN_PERCENT / 100)) {
+        return "worn, will double-click soon";
+    } else if (wear->bounce_recent_us >= (DEBOUNCE_DELAY_US * BUTTON_WEAR_WARN_PERCENT / 100)) {
+        return "wearing";
+    }
+    return "ok";
+}
+
+static void buttons_wear_bounce(int i, uint32_t us) {
+    struct button_wear *wear = &settings_get()->button_wear[i];
+
+    wear->bounce_hist[MIN(us / BUTTON_BOUNCE_BUCKET_US, BUTTON_BOUNCE_BUCKETS - 1)]++;
+    wear->bounce_max_us = MAX(wear->bounce_max_us, us);
+
+    int32_t diff = (int32_t)us - (int32_t)wear->bounce_recent_us;
+    wear->bounce_recent_us += diff / BUTTON_WEAR_AVERAGE;
+
+    bool warn = wear->bounce_recent_us >= (DEBOUNCE_DELAY_US * BUTTON_WEAR_WARN_PERCENT / 100);
+    if (warn && !wear_warned[i]) {
+        debug("button %d bounces for %luus on average, switch is %s",
+              i, wear->bounce_recent_us, buttons_wear_state(wear));
+    }
+    wear_warned[i] = warn;
+    wear_dirty = true;
+}
+
+#ifdef BUTTONS_PIO
+
+static void buttons_pio_irq(void) {
+    uint32_t now = time_us_32();
+
+    for (uint g = 0; g < group_count; g++) {
+        while (!pio_sm_is_rx_fifo_empty(BUTTON_PIO, groups[g].sm)) {
+            uint32_t pins = pio_sm_get(BUTTON_PIO, groups[g].sm);
+
+            // whole group is pushed, unchanged buttons are filtered later
+            for (uint b = 0; b < groups[g].count; b++) {
+                struct button_event ev = {
+                    .time = now,
+                    .id = groups[g].first + b,
+                    .state = !(pins & (1 << b)),
+                };
+                if (!rb_push(&event_ring, &ev)) {
+                    event_overflow = true;
+                }
+            }
+        }
+    }
+}
+
+static bool buttons_pio_add_group(uint first, uint count) {
+    if (group_count >= BUTTON_PIO_GROUPS) {
+        return false;
+    }
+
+    // each group needs its own copy, with the number of pins to sample
+    uint16_t instructions[count_of(button_scan_program_instructions)];
+    memcpy(instructions, button_scan_program_instructions, sizeof(instructions));
+    instructions[button_scan_offset_sample_in] = pio_encode_in(pio_pins, count);
+
+    struct pio_program program = {
+        .instructions = instructions,
+        .length = button_scan_program.length,
+        .origin = -1,
+    };
+
+    if (!pio_can_add_program(BUTTON_PIO, &program)) {
+        return false;
+    }
+
+    int sm = pio_claim_unused_sm(BUTTON_PIO, false);
+    if (sm < 0) {
+        return false;
+    }
+
+    uint offset = pio_add_program(BUTTON_PIO, &program);
+
+    groups[group_count].sm = sm;
+    groups[group_count].first = first;
+    groups[group_count].count = count;
+    group_count++;
+
+    // hold-off loop takes exactly the debounce time
+    float div = (float)clock_get_hz(clk_sys) * DEBOUNCE_DELAY_US
+                / (BUTTON_SCAN_HOLDOFF_CYCLES * 1000000.0f);
+
+    pio_set_irq0_source_enabled(BUTTON_PIO, pis_sm0_rx_fifo_not_empty + sm, true);
+    button_scan_program_init(BUTTON_PIO, sm, offset, gpio_num[first], count, div);
+    return true;
+}
+
+static void buttons_irq_init(void) {
+    irq_set_exclusive_handler(BUTTON_PIO_IRQ, buttons_pio_irq);
+    irq_set_enabled(BUTTON_PIO_IRQ, true);
+
+    for (uint first = 0; first < BUTTONS_COUNT; ) {
+        uint count = 1;
+        while (((first + count) < BUTTONS_COUNT)
+                && (gpio_num[first + count] == (gpio_num[first] + count))) {
+            count++;
+        }
+
+        if (!buttons_pio_add_group(first, count)) {
+            debug("no PIO resources left for buttons %u to %u", first, first + count - 1);
+        }
+
+        first += count;
+    }
+}
+
+#else // BUTTONS_PIO
+
+static void buttons_irq(void) {
+    uint32_t now = time_us_32();
+
+    for (int i = 0; i < BUTTONS_COUNT; i++) {
+        uint32_t events = gpio_get_irq_event_mask(gpio_num[i]) & BUTTON_EDGES;
+        if (!events) {
+            continue;
+        }
+        gpio_acknowledge_irq(gpio_num[i], events);
+
+        // both edges may have latched, the pin level tells where it ended
+        struct button_event ev = {
+            .time = now,
+            .id = i,
+            .state = !gpio_get(gpio_num[i]),
+        };
+        if (!rb_push(&event_ring, &ev)) {
+            event_overflow = true;
+        }
+    }
+}
+
+static void buttons_irq_init(void) {
+    uint32_t mask = 0;
+    for (int i = 0; i < BUTTONS_COUNT; i++) {
+        mask |= 1 << gpio_num[i];
+    }
+
+    gpio_add_raw_irq_handler_masked(mask, buttons_irq);
+    for (int i = 0; i < BUTTONS_COUNT; i++) {
+        gpio_set_irq_enabled(gpio_num[i], BUTTON_EDGES, true);
+    }
+    irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+#endif // BUTTONS_PIO
+
+static void buttons_report(int i, bool state, uint32_t time) {
+    controls_mouse_new(i, state, time);
+
+    struct button_wear *wear = &settings_get()->button_wear[i];
+    wear->changes++;
+    if (state) {
+        wear->presses++;
+        wear_presses++;
+    }
+    wear_dirty = true;
+}
+
+static void buttons_edge(int i, bool state, uint32_t time) {
+#ifdef BUTTONS_PIO
+    // already debounced by the state machine
+    if (state == buttons[i].db.current) {
+        return;
+    }
+    debounce_init(&buttons[i].db, state, time);
+    enum debounce_result r = DEBOUNCE_REPORT;
+#else // BUTTONS_PIO
+    enum debounce_result r = debounce_edge(&buttons[i].db, buttons[i].debounce, state, time);
+    if (r == DEBOUNCE_UNCHANGED) {
+        return;
+    }
+#endif // BUTTONS_PIO
+
+    settings_get()->button_wear[i].edges++;
+    last_activity_ms = to_ms_since_boot(get_absolute_time());
+
+    if (r == DEBOUNCE_REPORT) {
+        buttons_report(i, state, time);
+    }
+}
+
 void buttons_init(void) {
+    uint32_t now = time_us_32();
+
     for (int i = 0; i < BUTTONS_COUNT; i++) {
         gpio_init(gpio_num[i]);
         gpio_set_dir(gpio_num[i], GPIO_IN);
         gpio_pull_up(gpio_num[i]);
 
-        buttons[i].last_time = 0;
-        buttons[i].current_state = false;
-        buttons[i].last_state = false;
+        debounce_init(&buttons[i].db, false, now);
+        buttons[i].debounce = (settings_get()->button_debounce_eager & (1 << i))
+                              ? BUTTON_DEBOUNCE_EAGER : BUTTON_DEBOUNCE_DEFERRED;
     }
-}
 
-void buttons_run(void) {
+    // interrupts are enabled on the calling core, which also has to call buttons_run()
+    buttons_irq_init();
+
+    // buttons held at boot did not cause an edge
     for (int i = 0; i < BUTTONS_COUNT; i++) {
-        bool state = !gpio_get(gpio_num[i]);
-        uint32_t now = to_ms_since_boot(get_absolute_time());
+        buttons_edge(i, !gpio_get(gpio_num[i]), now);
+    }
+}
 
-        if (state != buttons[i].last_state) {
-            buttons[i].last_time = now;
+uint64_t buttons_run(void) {
+    struct button_event ev;
+    while (rb_pop(&event_ring, &ev)) {
+        buttons_edge(ev.id, ev.state, ev.time);
+    }
+
+    if (event_overflow) {
+        // lost edges in a chatter storm, take the current levels instead
+        event_overflow = false;
+        debug("button event ring overflow");
+
+        uint32_t now = time_us_32();
+        for (int i = 0; i < BUTTONS_COUNT; i++) {
+            buttons_edge(i, !gpio_get(gpio_num[i]), now);
         }
+    }
 
-        if ((now - buttons[i].last_time) > DEBOUNCE_DELAY_MS) {
-            if (state != buttons[i].current_state) {
-                buttons[i].current_state = state;
-                controls_mouse_new(i, state);
-            }
+    uint32_t now = time_us_32();
+    uint32_t wait = UINT32_MAX;
+
+    for (int i = 0; i < BUTTONS_COUNT; i++) {
+        enum debounce_result r;
+        uint32_t bounce;
+        wait = MIN(wait, debounce_poll(&buttons[i].db, buttons[i].debounce, now, &r, &bounce));
+
+        if (r == DEBOUNCE_REPORT) {
+            // the level is stable since its last edge
+            buttons_report(i, buttons[i].db.current, buttons[i].db.last_edge);
         }
+        if (bounce != UINT32_MAX) {
+            buttons_wear_bounce(i, bounce);
+        }
+    }
+
+    return (wait == UINT32_MAX) ? 0 : (time_us_64() + wait);
+}
+
+enum button_debounce buttons_get_debounce(int id) {
+    if ((id < 0) || (id >= BUTTONS_COUNT)) {
+        return BUTTON_DEBOUNCE_DEFERRED;
+    }
+    return buttons[id].debounce;
+}
+
+void buttons_set_debounce(int id, enum button_debounce mode) {
+    if ((id < 0) || (id >= BUTTONS_COUNT)) {
+        debug("invalid button %d", id);
+        return;
+    }
+
+#ifdef BUTTONS_PIO
+    debug("debounce is done by PIO, only stored for GPIO mode");
+#endif // BUTTONS_PIO
 
-        buttons[i].last_state = state;
+    // picked up by core 1 on the next edge
+    buttons[id].debounce = mode;
+
+    if (mode == BUTTON_DEBOUNCE_EAGER) {
+        settings_get()->button_debounce_eager |= 1 << id;
+    } else {
+        settings_get()->button_debounce_eager &= ~(1 << id);
     }
+    settings_save();
 }
 
+void buttons_wear_run(void) {
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+
+    bool due = wear_suspended
+            || ((now - last_wear_save_ms) >= BUTTON_WEAR_SAVE_INTERVAL_MS)
+            || (wear_presses >= BUTTON_WEAR_SAVE_PRESSES);
+
+    if (!wear_dirty || !due
+            || ((now - last_activity_ms) < BUTTON_WEAR_IDLE_MS)) {
+        return;
+    }
+
+    wear_dirty = false;
+    wear_presses = 0;
+    last_wear_save_ms = now;
+    settings_save();
+}
+
+void buttons_wear_set_suspended(bool suspended) {
+    wear_suspended = suspended;
+}
+
+void buttons_wear_reset(void) {
+    for (int i = 0; i < BUTTONS_COUNT; i++) {
+        memset(&settings_get()->button_wear[i], 0, sizeof(struct button_wear));
+        wear_warned[i] = false;
+    }
+    wear_dirty = true;
+}
+
+size_t buttons_wear_print(char *buff, size_t len) {
+    size_t pos = 0;
+
+    pos += snprintf(buff + pos, len - pos, "Button wear (debounce %dms):\r\n", DEBOUNCE_DELAY_MS);
+    for (int i = 0; i < BUTTONS_COUNT; i++) {
+        const struct button_wear *wear = &settings_get()->button_wear[i];
+
+        pos += snprintf(buff + pos, len - pos,
+                        "  %d: presses=%lu bounces=%lu recent=%luus max=%luus %s\r\n",
+                        i, wear->presses, wear->edges - wear->changes,
+                        wear->bounce_recent_us, wear->bounce_max_us, buttons_wear_state(wear));
+
+        pos += snprintf(buff + pos, len - pos, "    bounce/%dus:", BUTTON_BOUNCE_BUCKET_US);
+        for (int b = 0; b < BUTTON_BOUNCE_BUCKETS; b++) {
+            pos += snprintf(buff + pos, len - pos, " %lu", wear->bounce_hist[b]);
+        }
+        pos += snprintf(buff + pos, len - pos, "\r\n");
+    }
+
+    return pos;
+}
@@ -23,14 +23,25 @@
 #include "config.h"
 #include "log.h"
 #include "pmw3360.h"
+#include "pmw3360_power.h"
+#include "usb_hid.h"
+#include "latency.h"
 #include "util.h"
 #include "usb_cdc.h"
 #include "usb_msc.h"
 #include "debug.h"
+#include "boot.h"
+#include "core1.h"
+#include "prof.h"
+#include "buttons.h"
+#include "controls.h"
+#include "settings.h"
+#include "sched.h"
 #include "console.h"
 
 #define CNSL_BUFF_SIZE 1024
 #define CNSL_REPEAT_MS 500
+#define CNSL_DUMP_LINES 10 // per cnsl_run(), so USB can keep up
 
 //#define CNSL_REPEAT_PMW_STATUS_BY_DEFAULT
 
@@ -42,6 +53,230 @@ static char cnsl_last_command[CNSL_BUFF_SIZE + 1];
 static char cnsl_repeated_command[CNSL_BUFF_SIZE + 1];
 static bool repeat_command = false;
 static uint32_t last_repeat_time = 0;
+static uint8_t cnsl_frame[PMW_FRAME_CAPTURE_LEN];
+
+/*
+ * Sensor captures take a while, so they run as a job on core 1
+ * and the result is printed from cnsl_run() once it is done.
+ */
+enum cnsl_job_type {
+    CNSL_JOB_NONE = 0,
+    CNSL_JOB_DUMP,
+    CNSL_JOB_FRAME,
+    CNSL_JOB_REINIT,
+    CNSL_JOB_DATA_DUMP, // followed by CNSL_JOB_DATA_FRAME
+    CNSL_JOB_DATA_FRAME,
+};
+
+static struct core1_job cnsl_job;
+static enum cnsl_job_type cnsl_job_type = CNSL_JOB_NONE;
+static int cnsl_dump_samples = 0;
+static size_t cnsl_dump_line = 0, cnsl_dump_lines = 0;
+
+static int cnsl_dump_start(void *arg) {
+    (void)arg;
+    return pmw_dump_start();
+}
+
+static int cnsl_dump_run(void *arg) {
+    (void)arg;
+    return pmw_dump_run();
+}
+
+static int cnsl_frame_start(void *arg) {
+    (void)arg;
+    return pmw_frame_capture_start(cnsl_frame, PMW_FRAME_CAPTURE_LEN);
+}
+
+static int cnsl_frame_run(void *arg) {
+    (void)arg;
+    return pmw_frame_capture_run();
+}
+
+static int cnsl_reinit_start(void *arg) {
+    (void)arg;
+    return pmw_reinit_start();
+}
+
+static int cnsl_reinit_run(void *arg) {
+    (void)arg;
+    return pmw_reinit_run();
+}
+
+static bool cnsl_job_start(enum cnsl_job_type type) {
+    // the dump buffer is still being printed while cnsl_dump_line < cnsl_dump_lines
+    if ((cnsl_job_type != CNSL_JOB_NONE) || (cnsl_dump_line < cnsl_dump_lines)) {
+        println("busy with another PMW3360 command, try again later");
+        return false;
+    }
+
+    switch (type) {
+    case CNSL_JOB_DUMP:
+    case CNSL_JOB_DATA_DUMP:
+        cnsl_job = (struct core1_job){ .start = cnsl_dump_start, .run = cnsl_dump_run };
+        break;
+
+    case CNSL_JOB_FRAME:
+    case CNSL_JOB_DATA_FRAME:
+        cnsl_job = (struct core1_job){ .start = cnsl_frame_start, .run = cnsl_frame_run };
+        break;
+
+    default:
+        cnsl_job = (struct core1_job){ .start = cnsl_reinit_start, .run = cnsl_reinit_run };
+        break;
+    }
+
+    if (!core1_job_start(&cnsl_job)) {
+        println("PMW3360 is busy, try again later");
+        return false;
+    }
+
+    cnsl_job_type = type;
+    return true;
+}
+
+static void cnsl_msc_write(bool data) {
+    if (msc_is_medium_available()) {
+        println("Currently mounted. Unplugging now.");
+        msc_set_medium_available(false);
+    }
+
+    if (debug_msc_mount() != 0) {
+        println("Error mounting file system.");
+        return;
+    }
+
+    println("Writing data to file system");
+
+    if (data) {
+        debug_msc_pmw3360(cnsl_dump_samples, cnsl_frame, cnsl_job.result);
+    }
+
+    debug_msc_stats();
+
+    if (debug_msc_unmount() != 0) {
+        println("Error unmounting file system.");
+    }
+
+    println("Done. Plugging in now.");
+    msc_set_medium_available(true);
+}
+
+static void cnsl_job_finish(int r) {
+    enum cnsl_job_type type = cnsl_job_type;
+    cnsl_job_type = CNSL_JOB_NONE;
+
+    switch (type) {
+    case CNSL_JOB_DUMP:
+        println("captured %d samples", r);
+        cnsl_dump_line = 0;
+        cnsl_dump_lines = r + 1; // with header
+        break;
+
+    case CNSL_JOB_FRAME:
+        if (r == PMW_FRAME_CAPTURE_LEN) {
+            println("PMW3360 frame capture:");
+            hexdump(cnsl_frame, PMW_FRAME_CAPTURE_LEN);
+        } else {
+            println("error capturing frame (%d)", r);
+        }
+        println();
+        break;
+
+    case CNSL_JOB_REINIT:
+        if (r < 0) {
+            println("error initializing PMW3360");
+        } else {
+            println("PMW3360 re-initialized successfully");
+        }
+        println();
+        break;
+
+    case CNSL_JOB_DATA_DUMP:
+        println("captured %d samples, now capturing a frame", r);
+        cnsl_dump_samples = r;
+        if (!cnsl_job_start(CNSL_JOB_DATA_FRAME)) {
+            println();
+        }
+        break;
+
+    case CNSL_JOB_DATA_FRAME:
+        cnsl_msc_write(true);
+        println();
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void cnsl_job_poll(void) {
+    struct core1_job *job = core1_job_done();
+    if (job != NULL) {
+        cnsl_job_finish(job->result);
+    }
+
+    // dump is printed in small parts, the CSV is written to disk at once
+    static char line[100];
+    for (int i = 0; (i < CNSL_DUMP_LINES) && (cnsl_dump_line < cnsl_dump_lines); i++) {
+        pmw_dump_print(cnsl_dump_line++, line, sizeof(line));
+        print("%s", line);
+        if (cnsl_dump_line == cnsl_dump_lines) {
+            println();
+        }
+    }
+}
+
+struct cnsl_buff {
+    char *buff;
+    size_t len;
+};
+
+static void cnsl_pmw_status(void *arg) {
+    struct cnsl_buff *b = arg;
+    pmw_print_status(b->buff, b->len);
+}
+
+static void cnsl_pmw_get_sensitivity(void *arg) {
+    *((uint8_t *)arg) = pmw_get_sensitivity();
+}
+
+static void cnsl_pmw_set_sensitivity(void *arg) {
+    pmw_set_sensitivity(*((uint8_t *)arg));
+}
+
+static void cnsl_pmw_get_angle(void *arg) {
+    *((int8_t *)arg) = pmw_get_angle();
+}
+
+static void cnsl_pmw_set_angle(void *arg) {
+    pmw_set_angle(*((int8_t *)arg));
+}
+
+static void cnsl_power_set(void *arg) {
+    pmw_power_set_profile(*((enum pmw_profile *)arg));
+}
+
+static void cnsl_wear_reset(void *arg) {
+    (void)arg;
+    buttons_wear_reset();
+}
+
+struct cnsl_map {
+    int layer, id;
+    struct button_action action;
+    int r;
+};
+
+static void cnsl_map_set(void *arg) {
+    struct cnsl_map *map = arg;
+    map->r = controls_set_action(map->layer, map->id, map->action);
+}
+
+static void cnsl_map_reset(void *arg) {
+    (void)arg;
+    controls_keymap_reset();
+}
 
 static void cnsl_interpret(const char *line) {
     if (strlen(line) == 0) {
@@ -70,10 +305,37 @@ static void cnsl_interpret(const char *line) {
         println("  cpi N - set sensitivity");
         println("  angle - print current angle");
         println("angle N - set angle");
+        println("  power - print power profile");
+        println("power P - set power profile (competitive, balanced, idle-saver)");
+        println(" report - print mouse report format");
+        println("report N - set mouse report format (8 or 16 bit), re-enumerates");
+        println("    hid - print HID report statistics");
+        println("    lat - print motion to USB latency");
+        println("lat reset - reset latency histograms");
+#ifdef MAIN_LOOP_PROFILER
+        println("   prof - print main loop task profile");
+        println("prof reset - reset main loop task profile");
+#endif // MAIN_LOOP_PROFILER
+        println("  sched - print scheduler idle time and wake-up latency");
+        println("sched reset - reset scheduler statistics");
+        println("   rate - print USB polling rate");
+        println(" rate N - set USB polling rate (125, 250, 500, 1000Hz), re-enumerates");
         println("   pmws - print PMW3360 status");
         println("   pmwf - print PMW3360 frame capture");
         println("   pmwd - print PMW3360 data dump");
         println("   pmwr - reset PMW3360");
+        println("debounce - print button debounce modes");
+        println("debounce N M - set debounce mode of button N (eager, deferred)");
+        println("    map - print button map");
+        println("map L B A - map button B on layer L to action A:");
+        println("            none, mouse left|middle|right|back|forward, scroll,");
+        println("            cpi N, key CODE [MODIFIERS], layer N, disabled");
+        println("map reset - restore default button map");
+        println("   wear - print button switch wear statistics");
+        println("wear save - store wear statistics now, otherwise done on USB suspend");
+        println("            or after 1000 presses or 4 hours, up to that is lost on power-off");
+        println("wear reset - reset wear statistics, eg. after replacing a switch");
+        println("   boot - print boot timeline");
         println("  reset - reset back into this firmware");
         println("   \\x18 - reset to bootloader");
         println(" repeat - repeat last command every %d milliseconds", CNSL_REPEAT_MS);
@@ -85,33 +347,29 @@ static void cnsl_interpret(const char *line) {
         println("Use repeat to continuously execute last command.");
         println("Stop this by calling repeat again.");
     } else if (strcmp(line, "pmws") == 0) {
-        char status_buff[1024];
-        pmw_print_status(status_buff, sizeof(status_buff));
+        static char status_buff[2048];
+        struct cnsl_buff b = { .buff = status_buff, .len = sizeof(status_buff) };
+        core1_call(cnsl_pmw_status, &b);
         print("%s", status_buff);
+    } else if (strcmp(line, "boot") == 0) {
+        char timeline_buff[512];
+        boot_print_timeline(timeline_buff, sizeof(timeline_buff));
+        print("%s", timeline_buff);
     } else if (strcmp(line, "pmwd") == 0) {
-        pmw_dump_data(true);
+        if (cnsl_job_start(CNSL_JOB_DUMP)) {
+            println("Will now capture %u data samples from PMW3360", PMW_DATA_DUMP_SAMPLES);
+            println("Move trackball to generate some data!");
+        }
     } else if (strcmp(line, "pmwf") == 0) {
-        uint8_t frame[PMW_FRAME_CAPTURE_LEN];
-        ssize_t r = pmw_frame_capture(frame, PMW_FRAME_CAPTURE_LEN);
-        if (r == PMW_FRAME_CAPTURE_LEN) {
-            println("PMW3360 frame capture:");
-            hexdump(frame, PMW_FRAME_CAPTURE_LEN);
-
-            println("Re-Initializing PMW3360");
-            pmw_init();
-        } else {
-            println("error capturing frame (%d)", r);
+        if (cnsl_job_start(CNSL_JOB_FRAME)) {
+            println("capturing frame, PMW3360 will be re-initialized afterwards");
         }
     } else if (strcmp(line, "pmwr") == 0) {
         println("user requests re-initializing of PMW3360");
-        int r = pmw_init();
-        if (r < 0) {
-            println("error initializing PMW3360");
-        } else {
-            println("PMW3360 re-initialized successfully");
-        }
+        cnsl_job_start(CNSL_JOB_REINIT);
     } else if (strcmp(line, "cpi") == 0) {
-        uint8_t sense = pmw_get_sensitivity();
+        uint8_t sense;
+        core1_call(cnsl_pmw_get_sensitivity, &sense);
         uint16_t cpi = PMW_SENSE_TO_CPI(sense);
         println("current cpi: %u (0x%02X)", cpi, sense);
     } else if (str_startswith(line, "cpi ")) {
@@ -120,12 +378,13 @@ static void cnsl_interpret(const char *line) {
         if ((num < 100) || (num > 12000)) {
             println("invalid cpi %llu, needs to be %u <= cpi <= %u", num, 100, 12000);
         } else {
-            num = PMW_CPI_TO_SENSE(num);
-            println("setting cpi to 0x%02llX", num);
-            pmw_set_sensitivity(num);
+            uint8_t sense = PMW_CPI_TO_SENSE(num);
+            println("setting cpi to 0x%02X", sense);
+            core1_call(cnsl_pmw_set_sensitivity, &sense);
         }
     } else if (strcmp(line, "angle") == 0) {
-        int8_t angle = pmw_get_angle();
+        int8_t angle;
+        core1_call(cnsl_pmw_get_angle, &angle);
         println("current angle: %d", angle);
     } else if (str_startswith(line, "angle ")) {
         const char *num_str = line + 6;
@@ -135,36 +394,139 @@ static void cnsl_interpret(const char *line) {
         } else {
             int8_t tmp = num;
             println("setting angle to %d", tmp);
-            pmw_set_angle(num);
+            core1_call(cnsl_pmw_set_angle, &tmp);
         }
-    } else if (strcmp(line, "reset") == 0) {
-        reset_to_main();
-    } else if ((strcmp(line, "stats") == 0) || (strcmp(line, "data") == 0)) {
-        if (msc_is_medium_available()) {
-            println("Currently mounted. Unplugging now.");
-            msc_set_medium_available(false);
+    } else if (strcmp(line, "power") == 0) {
+        println("current power profile: %s", pmw_profile_name(pmw_power_get_profile()));
+    } else if (str_startswith(line, "power ")) {
+        int profile = pmw_profile_from_name(line + 6);
+        if (profile < 0) {
+            println("invalid power profile \"%s\"", line + 6);
+        } else {
+            enum pmw_profile p = profile;
+            println("setting power profile to %s", pmw_profile_name(p));
+            core1_call(cnsl_power_set, &p);
+            settings_save();
         }
-
-        if (debug_msc_mount() != 0) {
-            println("Error mounting file system.");
-            println();
-            return;
+    } else if (strcmp(line, "report") == 0) {
+        println("current mouse report: %s",
+                (usb_hid_get_mouse_report() == HID_MOUSE_REPORT_16BIT) ? "16bit" : "8bit");
+    } else if (str_startswith(line, "report ")) {
+        uintmax_t num = strtoumax(line + 7, NULL, 10);
+        if ((num != 8) && (num != 16)) {
+            println("invalid report size %llu, needs to be 8 or 16", num);
+        } else {
+            println("switching to %llubit mouse report, USB will reconnect", num);
+            usb_hid_set_mouse_report((num == 16) ? HID_MOUSE_REPORT_16BIT : HID_MOUSE_REPORT_8BIT);
         }
-
-        println("Writing data to file system");
-
-        if (strcmp(line, "data") == 0) {
-            debug_msc_pmw3360();
+    } else if (strcmp(line, "hid") == 0) {
+        char status_buff[256];
+        usb_hid_print_status(status_buff, sizeof(status_buff));
+        print("%s", status_buff);
+    } else if (strcmp(line, "lat") == 0) {
+        static char latency_buff[512];
+        latency_print(latency_buff, sizeof(latency_buff));
+        print("%s", latency_buff);
+    } else if (strcmp(line, "lat reset") == 0) {
+        latency_reset();
+        println("latency histograms reset");
+    } else if (strcmp(line, "sched") == 0) {
+        static char sched_buff[512];
+        sched_print(sched_buff, sizeof(sched_buff));
+        print("%s", sched_buff);
+    } else if (strcmp(line, "sched reset") == 0) {
+        sched_reset();
+        println("scheduler statistics reset");
+#ifdef MAIN_LOOP_PROFILER
+    } else if (strcmp(line, "prof") == 0) {
+        static char prof_buff[2048];
+        prof_print(prof_buff, sizeof(prof_buff));
+        print("%s", prof_buff);
+    } else if (strcmp(line, "prof reset") == 0) {
+        prof_reset();
+        println("profile reset");
+#endif // MAIN_LOOP_PROFILER
+    } else if (strcmp(line, "debounce") == 0) {
+        for (int i = 0; i < BUTTONS_COUNT; i++) {
+            println("button %d: %s", i,
+                    (buttons_get_debounce(i) == BUTTON_DEBOUNCE_EAGER) ? "eager" : "deferred");
+        }
+    } else if (str_startswith(line, "debounce ")) {
+        char *mode = NULL;
+        uintmax_t num = strtoumax(line + 9, &mode, 10);
+        while (*mode == ' ') {
+            mode++;
         }
 
-        debug_msc_stats();
-
-        if (debug_msc_unmount() != 0) {
-            println("Error unmounting file system.");
+        if ((mode == (line + 9)) || (num >= BUTTONS_COUNT)) {
+            println("invalid button, needs to be 0 to %d", BUTTONS_COUNT - 1);
+        } else if (strcmp(mode, "eager") == 0) {
+            println("button %llu now uses eager debounce", num);
+            buttons_set_debounce(num, BUTTON_DEBOUNCE_EAGER);
+        } else if (strcmp(mode, "deferred") == 0) {
+            println("button %llu now uses deferred debounce", num);
+            buttons_set_debounce(num, BUTTON_DEBOUNCE_DEFERRED);
+        } else {
+            println("invalid debounce mode \"%s\"", mode);
+        }
+    } else if (strcmp(line, "map") == 0) {
+        static char map_buff[768];
+        controls_keymap_print(map_buff, sizeof(map_buff));
+        print("%s", map_buff);
+    } else if (strcmp(line, "map reset") == 0) {
+        core1_call(cnsl_map_reset, NULL);
+        settings_save();
+        println("button map reset");
+    } else if (str_startswith(line, "map ")) {
+        struct cnsl_map map;
+        char *end = NULL;
+        map.layer = strtoumax(line + 4, &end, 10);
+        map.id = strtoumax(end, &end, 10);
+        while (*end == ' ') {
+            end++;
         }
 
-        println("Done. Plugging in now.");
-        msc_set_medium_available(true);
+        if (controls_action_parse(end, &map.action) != 0) {
+            println("invalid action \"%s\"", end);
+        } else {
+            core1_call(cnsl_map_set, &map);
+            if (map.r != 0) {
+                println("invalid layer %d or button %d", map.layer, map.id);
+            } else {
+                settings_save();
+                println("mapped button %d on layer %d to %s", map.id, map.layer, end);
+            }
+        }
+    } else if (strcmp(line, "wear") == 0) {
+        static char wear_buff[768];
+        buttons_wear_print(wear_buff, sizeof(wear_buff));
+        print("%s", wear_buff);
+    } else if (strcmp(line, "wear save") == 0) {
+        settings_save();
+        println("button wear statistics stored");
+    } else if (strcmp(line, "wear reset") == 0) {
+        core1_call(cnsl_wear_reset, NULL);
+        settings_save();
+        println("button wear statistics reset");
+    } else if (strcmp(line, "rate") == 0) {
+        println("current polling rate: %dHz", 1000 / usb_hid_get_interval());
+    } else if (str_startswith(line, "rate ")) {
+        uintmax_t num = strtoumax(line + 5, NULL, 10);
+        if ((num != 125) && (num != 250) && (num != 500) && (num != 1000)) {
+            println("invalid polling rate %llu, needs to be 125, 250, 500 or 1000", num);
+        } else {
+            println("switching to %lluHz polling rate, USB will reconnect", num);
+            usb_hid_set_interval(1000 / num);
+        }
+    } else if (strcmp(line, "reset") == 0) {
+        reset_to_main();
+    } else if (strcmp(line, "stats") == 0) {
+        cnsl_msc_write(false);
+    } else if (strcmp(line, "data") == 0) {
+        if (cnsl_job_start(CNSL_JOB_DATA_DUMP)) {
+            println("Capturing %u data samples and a frame from PMW3360", PMW_DATA_DUMP_SAMPLES);
+            println("Move trackball to generate some data!");
+        }
     } else if (strcmp(line, "mount") == 0) {
         bool state = msc_is_medium_available();
         println("Currently %s. %s now.",
@@ -202,6 +564,8 @@ static int32_t cnsl_find_line_end(void) {
 }
 
 void cnsl_run(void) {
+    cnsl_job_poll();
+
     if (repeat_command && (strlen(cnsl_repeated_command) > 0)
             && (strcmp(cnsl_repeated_command, "repeat") != 0)) {
         uint32_t now = to_ms_since_boot(get_absolute_time());
@@ -16,93 +16,414 @@
  * See <http://www.gnu.org/licenses/>.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
 
 #include "pico/stdlib.h"
 
 #include "config.h"
 #include "log.h"
 #include "pmw3360.h"
+#include "latency.h"
+#include "settings.h"
 #include "controls.h"
 
 static struct mouse_state mouse, last_mouse;
-static uint64_t scroll_sum = 0;
+static int32_t carry_x = 0, carry_y = 0;
+static int32_t delta_max = MOUSE_DELTA_MAX_8BIT;
+
+enum fake_middle_state {
+    FAKE_MIDDLE_IDLE = 0,
+    FAKE_MIDDLE_HELD, // scroll-lock is held
+    FAKE_MIDDLE_CLICK, // middle button is pressed
+};
+
+static struct {
+    enum fake_middle_state state;
+    uint32_t start; // button edge of the current state
+    uint32_t moved; // sensor counts while held
+    bool reported;
+} fake_middle;
+
+static struct button_action active[BUTTONS_COUNT]; // what held buttons are doing
+
+static const char *action_names[ACTION_COUNT] = {
+    [ACTION_NONE] = "none",
+    [ACTION_MOUSE] = "mouse",
+    [ACTION_SCROLL_LOCK] = "scroll",
+    [ACTION_CPI] = "cpi",
+    [ACTION_KEY] = "key",
+    [ACTION_LAYER] = "layer",
+    [ACTION_DISABLED] = "disabled",
+};
+
+static const char *mouse_button_names[MOUSE_BUTTONS_COUNT] = {
+    [MOUSE_LEFT] = "left",
+    [MOUSE_MIDDLE] = "middle",
+    [MOUSE_RIGHT] = "right",
+    [MOUSE_BACK] = "back",
+    [MOUSE_FORWARD] = "forward",
+};
 
 void controls_init(void) {
     for (int i = 0; i < MOUSE_BUTTONS_COUNT; i++) {
         mouse.button[i] = false;
     }
     mouse.changed = false;
+    mouse.keys_changed = false;
     mouse.delta_x = 0;
     mouse.delta_y = 0;
     mouse.scroll_x = 0;
     mouse.scroll_y = 0;
     mouse.scroll_lock = false;
-    mouse.fake_middle = 0;
+    mouse.key_modifier = 0;
+    memset(mouse.keycode, 0, sizeof(mouse.keycode));
+    mouse.samples = 0;
+    mouse.sample_time = 0;
+    mouse.sample_time_oldest = 0;
+    carry_x = 0;
+    carry_y = 0;
+
+    memset(active, 0, sizeof(active));
+
+    fake_middle.state = FAKE_MIDDLE_IDLE;
+    fake_middle.start = 0;
+    fake_middle.moved = 0;
+    fake_middle.reported = false;
 
     last_mouse = mouse;
 }
 
-void controls_mouse_new(int id, bool state) {
+void controls_set_delta_max(int32_t max) {
+    delta_max = max;
+}
+
+/*
+ * A short tap of scroll-lock without scrolling becomes a middle click.
+ * The tap is timed with the button edges, so the click is the same
+ * at every polling rate.
+ */
+static void fake_middle_scroll_lock(bool state, uint32_t time) {
+    if (state) {
+        // a click still in progress ends here
+        if (fake_middle.state == FAKE_MIDDLE_CLICK) {
+            mouse.button[MOUSE_MIDDLE] = false;
+        }
+        fake_middle.state = FAKE_MIDDLE_HELD;
+        fake_middle.start = time;
+        fake_middle.moved = 0;
+        return;
+    }
+
+    if (fake_middle.state != FAKE_MIDDLE_HELD) {
+        return;
+    }
+
+    uint32_t threshold = MOUSE_FAKE_MIDDLE_MOVE_COUNTS * pmw_get_cpi() / 1000;
+    bool tap = (MOUSE_FAKE_MIDDLE_TAP_MS == 0)
+            || ((time - fake_middle.start) <= (MOUSE_FAKE_MIDDLE_TAP_MS * 1000UL));
+
+    if (tap && (fake_middle.moved < threshold)) {
+        // fake middle mouse click, user was not scrolling
+        mouse.button[MOUSE_MIDDLE] = true;
+        fake_middle.state = FAKE_MIDDLE_CLICK;
+        fake_middle.start = time;
+        fake_middle.reported = false;
+    } else {
+        fake_middle.state = FAKE_MIDDLE_IDLE;
+    }
+}
+
+static void fake_middle_read(void) {
+    if (fake_middle.state != FAKE_MIDDLE_CLICK) {
+        return;
+    }
+
+    // the press has to reach the host at least once
+    uint32_t now = time_us_32();
+    if (fake_middle.reported
+            && ((now - fake_middle.start) >= (MOUSE_FAKE_MIDDLE_HOLD_MS * 1000UL))) {
+        mouse.button[MOUSE_MIDDLE] = false;
+        fake_middle.state = FAKE_MIDDLE_IDLE;
+    } else {
+        fake_middle.reported = true;
+    }
+}
+
+// highest layer of all held layer keys, releasing one keeps the others
+static uint8_t controls_layer(void) {
+    uint8_t held = 0;
+    for (int i = 0; i < BUTTONS_COUNT; i++) {
+        if (active[i].type == ACTION_LAYER) {
+            held |= 1 << active[i].arg;
+        }
+    }
+
+    for (int l = BUTTON_LAYERS - 1; l > 0; l--) {
+        if (held & (1 << l)) {
+            return l;
+        }
+    }
+    return 0;
+}
+
+// moves new sensor samples into the carry, or to scrolling while scroll-lock is held
+static void controls_samples_take(void) {
+    struct pmw_sample sample;
+    while (pmw_get_sample(&sample)) {
+        carry_x += sample.delta_x;
+        carry_y += sample.delta_y;
+        if (mouse.samples == 0) {
+            mouse.sample_time_oldest = sample.time_us;
+        }
+        mouse.sample_time = sample.time_us;
+        mouse.samples++;
+    }
+
+    if (mouse.scroll_lock) {
+        // scrolling is scaled down, so it can use everything
+        mouse.internal_scroll_x += carry_x;
+        mouse.internal_scroll_y += carry_y;
+        fake_middle.moved += abs(carry_x) + abs(carry_y);
+        carry_x = 0;
+        carry_y = 0;
+    }
+}
+
+void controls_mouse_new(int id, bool state, uint32_t time) {
     //debug("button %d %s", id, state ? "pressed" : "released");
 
-    switch (id) {
-    case 0:
-        mouse.button[MOUSE_BACK] = state;
+    if ((id < 0) || (id >= BUTTONS_COUNT)) {
+        return;
+    }
+
+    // a release undoes what the press did, even when the layer changed
+    struct button_action action;
+    if (state) {
+        action = settings_get()->keymap[controls_layer()][id];
+        if (action.type == ACTION_NONE) {
+            action = settings_get()->keymap[0][id];
+        }
+        active[id] = action;
+    } else {
+        action = active[id];
+        active[id].type = ACTION_NONE;
+    }
+
+    switch (action.type) {
+    case ACTION_MOUSE:
+        mouse.button[action.arg] = state;
         break;
 
-    case 1:
+    case ACTION_SCROLL_LOCK:
+        // motion so far belongs to the previous mode
+        controls_samples_take();
         mouse.scroll_lock = state;
+        fake_middle_scroll_lock(state, time);
         break;
 
-    case 2:
-        mouse.button[MOUSE_LEFT] = state;
+    case ACTION_CPI:
+        if (state) {
+            pmw_set_sensitivity(action.arg);
+        }
         break;
 
-    case 3:
-        mouse.button[MOUSE_RIGHT] = state;
+    default:
+        // keys and layers are collected from the held actions
         break;
     }
 }
 
-static bool mouse_state_changed(struct mouse_state a, struct mouse_state b) {
+static bool mouse_keys_changed(struct mouse_state a, struct mouse_state b) {
+    return (a.key_modifier != b.key_modifier)
+            || (memcmp(a.keycode, b.keycode, sizeof(a.keycode)) != 0);
+}
+
+static void controls_keys_read(void) {
+    size_t n = 0;
+    mouse.key_modifier = 0;
+    memset(mouse.keycode, 0, sizeof(mouse.keycode));
+
+    for (int i = 0; i < BUTTONS_COUNT; i++) {
+        if (active[i].type != ACTION_KEY) {
+            continue;
+        }
+
+        mouse.key_modifier |= active[i].mod;
+        if ((active[i].arg != 0) && (n < sizeof(mouse.keycode))) {
+            mouse.keycode[n++] = active[i].arg;
+        }
+    }
+}
+
+int controls_set_action(int l, int id, struct button_action action) {
+    if ((l < 0) || (l >= BUTTON_LAYERS) || (id < 0) || (id >= BUTTONS_COUNT)) {
+        return -1;
+    }
+
+    settings_get()->keymap[l][id] = action;
+    return 0;
+}
+
+void controls_keymap_reset(void) {
+    static const struct button_action keymap[BUTTON_LAYERS][BUTTONS_COUNT] = CONTROLS_DEFAULT_KEYMAP;
+    memcpy(settings_get()->keymap, keymap, sizeof(keymap));
+}
+
+int controls_action_parse(const char *s, struct button_action *action) {
+    char *end = NULL;
+    memset(action, 0, sizeof(struct button_action));
+
+    for (int i = 0; i < ACTION_COUNT; i++) {
+        size_t l = strlen(action_names[i]);
+        if ((strncmp(s, action_names[i], l) == 0) && ((s[l] == ' ') || (s[l] == '\0'))) {
+            action->type = i;
+            s += l;
+            break;
+        }
+        if (i == (ACTION_COUNT - 1)) {
+            return -1;
+        }
+    }
+    while (*s == ' ') {
+        s++;
+    }
+
+    switch (action->type) {
+    case ACTION_MOUSE:
+        for (int i = 0; i < MOUSE_BUTTONS_COUNT; i++) {
+            if (strcmp(s, mouse_button_names[i]) == 0) {
+                action->arg = i;
+                return 0;
+            }
+        }
+        return -1;
+
+    case ACTION_CPI: {
+        uintmax_t cpi = strtoumax(s, &end, 10);
+        if ((end == s) || (cpi < PMW_SENSE_TO_CPI(0)) || (cpi > PMW_SENSE_TO_CPI(0x77))) {
+            return -1;
+        }
+        action->arg = PMW_CPI_TO_SENSE(cpi);
+        return 0;
+    }
+
+    case ACTION_KEY: {
+        uintmax_t key = strtoumax(s, &end, 0);
+        if ((end == s) || (key > 0xFF)) {
+            return -1;
+        }
+        uintmax_t mod = strtoumax(end, NULL, 0);
+        if (mod > 0xFF) {
+            return -1;
+        }
+        action->arg = key;
+        action->mod = mod;
+        return 0;
+    }
+
+    case ACTION_LAYER: {
+        uintmax_t l = strtoumax(s, &end, 10);
+        if ((end == s) || (l >= BUTTON_LAYERS)) {
+            return -1;
+        }
+        action->arg = l;
+        return 0;
+    }
+
+    default:
+        return 0;
+    }
+}
+
+static size_t controls_action_print(const struct button_action *a, char *buff, size_t len) {
+    uint8_t type = (a->type < ACTION_COUNT) ? a->type : ACTION_NONE;
+    size_t pos = snprintf(buff, len, "%s", action_names[type]);
+
+    switch (type) {
+    case ACTION_MOUSE:
+        pos += snprintf(buff + pos, len - pos, " %s",
+                        (a->arg < MOUSE_BUTTONS_COUNT) ? mouse_button_names[a->arg] : "?");
+        break;
+
+    case ACTION_CPI:
+        pos += snprintf(buff + pos, len - pos, " %d", PMW_SENSE_TO_CPI(a->arg));
+        break;
+
+    case ACTION_KEY:
+        pos += snprintf(buff + pos, len - pos, " 0x%02X 0x%02X", a->arg, a->mod);
+        break;
+
+    case ACTION_LAYER:
+        pos += snprintf(buff + pos, len - pos, " %d", a->arg);
+        break;
+    }
+
+    return pos;
+}
+
+size_t controls_keymap_print(char *buff, size_t len) {
+    size_t pos = 0;
+
+    pos += snprintf(buff + pos, len - pos, "Button map (current layer %d):\r\n", controls_layer());
+    for (int l = 0; l < BUTTON_LAYERS; l++) {
+        for (int i = 0; i < BUTTONS_COUNT; i++) {
+            const struct button_action *a = &settings_get()->keymap[l][i];
+            if ((l > 0) && (a->type == ACTION_NONE)) {
+                continue;
+            }
+
+            pos += snprintf(buff + pos, len - pos, "  layer %d button %d: ", l, i);
+            pos += controls_action_print(a, buff + pos, len - pos);
+            pos += snprintf(buff + pos, len - pos, "\r\n");
+        }
+    }
+
+    return pos;
+}
+
+static bool mouse_buttons_changed(struct mouse_state a, struct mouse_state b) {
     for (int i = 0; i < MOUSE_BUTTONS_COUNT; i++) {
         if (a.button[i] != b.button[i]) {
             return true;
         }
     }
+    return false;
+}
 
-    if ((a.delta_x != b.delta_x)
-            || (a.delta_y != b.delta_y)
-            || (a.scroll_x != b.scroll_x)
-            || (a.scroll_y != b.scroll_y)) {
-        return true;
+// hand out at most limit counts, the rest is kept for the next report
+static int16_t motion_take(int32_t *carry, int32_t limit) {
+    int32_t delta = *carry;
+    if (delta > limit) {
+        delta = limit;
+    } else if (delta < -limit) {
+        delta = -limit;
     }
-
-    return false;
+    *carry -= delta;
+    return delta;
 }
 
 struct mouse_state controls_mouse_read(void) {
-    struct pmw_motion motion = pmw_get();
+    controls_samples_take();
 
-    if (motion.motion) {
-        mouse.delta_x = motion.delta_x;
-        mouse.delta_y = motion.delta_y;
+    if (mouse.samples > 0) {
+        latency_add(LAT_CONTROLS_READ, mouse.sample_time_oldest);
     }
 
-    mouse.scroll_x = 0;
-    mouse.scroll_y = 0;
-
     if (mouse.scroll_lock) {
-        scroll_sum += abs(mouse.delta_x);
-        scroll_sum += abs(mouse.delta_y);
-
-        mouse.internal_scroll_x += mouse.delta_x;
-        mouse.internal_scroll_y += mouse.delta_y;
-
         mouse.delta_x = 0;
         mouse.delta_y = 0;
+    } else {
+        mouse.delta_x = motion_take(&carry_x, delta_max);
+        mouse.delta_y = motion_take(&carry_y, delta_max);
+    }
+
+    mouse.scroll_x = 0;
+    mouse.scroll_y = 0;
 
+    if (mouse.scroll_lock) {
         while (mouse.internal_scroll_x > SCROLL_REDUCE_SENSITIVITY) {
             mouse.scroll_x += 1;
             mouse.internal_scroll_x -= SCROLL_REDUCE_SENSITIVITY;
@@ -125,33 +446,22 @@ struct mouse_state controls_mouse_read(void) {
         mouse.internal_scroll_y = 0;
     }
 
-    if (mouse.fake_middle > 0) {
-        mouse.fake_middle++;
-        if (mouse.fake_middle > MOUSE_FAKE_MIDDLE_CLICK_TIME) {
-            mouse.fake_middle = 0;
-            mouse.button[MOUSE_MIDDLE] = false;
-        }
-    }
+    fake_middle_read();
 
-    if (!mouse.scroll_lock && last_mouse.scroll_lock) {
-        // middle mouse button was held and has now been released
-        if (scroll_sum < MIN_SCROLL_SUPPRESS_CLICK) {
-            // fake middle mouse click, user was not scrolling
-            mouse.button[MOUSE_MIDDLE] = true;
-            mouse.fake_middle = 1;
-        }
-        scroll_sum = 0;
-    }
+    controls_keys_read();
 
-    if (mouse_state_changed(mouse, last_mouse)
+    // relative axes only need a report while they are non-zero,
+    // buttons whenever they differ from the last report.
+    // keys go out in their own report, so they do not need a mouse report
+    mouse.keys_changed = mouse_keys_changed(mouse, last_mouse);
+    mouse.changed = mouse_buttons_changed(mouse, last_mouse)
             || (mouse.delta_x != 0)
             || (mouse.delta_y != 0)
             || (mouse.scroll_x != 0)
-            || (mouse.scroll_y != 0)) {
-        mouse.changed = true;
-    }
+            || (mouse.scroll_y != 0);
 
     last_mouse = mouse;
-    return mouse;
+    mouse.samples = 0;
+    return last_mouse;
 }
 
@@ -0,0 +1,224 @@
+/*
+ * core1.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/watchdog.h"
+
+#include "config.h"
+#include "log.h"
+#include "ring.h"
+#include "boot.h"
+#include "buttons.h"
+#include "controls.h"
+#include "pmw3360.h"
+#include "sched.h"
+#include "core1.h"
+
+#define CORE1_REQUESTS 8
+#define CORE1_REPORTS 4
+#define CORE1_ALIVE_TIMEOUT_MS 100
+#define CORE1_CALL_DONE 0xC0DE0001
+#define CORE1_JOBS_DONE 2
+#define CORE1_JOB_STEP_US 100 // gap between steps of a job
+
+// sent to core 1 instead of a struct core1_call pointer
+#define CORE1_REQ_REPORT 1
+
+struct core1_call {
+    void (*fn)(void *arg);
+    void *arg;
+};
+
+static uintptr_t request_buff[CORE1_REQUESTS];
+static struct ring_buffer request_ring = RB_INIT(request_buff, CORE1_REQUESTS, sizeof(uintptr_t));
+
+static struct mouse_state report_buff[CORE1_REPORTS];
+static struct ring_buffer report_ring = RB_INIT(report_buff, CORE1_REPORTS, sizeof(struct mouse_state));
+
+static struct core1_job *job_buff[CORE1_JOBS_DONE];
+static struct ring_buffer job_ring = RB_INIT(job_buff, CORE1_JOBS_DONE, sizeof(struct core1_job *));
+static struct core1_job *job_current = NULL;
+
+static volatile uint32_t core1_ticks = 0;
+static uint32_t last_ticks = 0;
+static uint32_t last_tick_change = 0;
+
+static void core1_handle_requests(void) {
+    core1_ticks++;
+
+    uintptr_t req;
+    while (rb_pop(&request_ring, &req)) {
+        if (req == CORE1_REQ_REPORT) {
+            // reading takes motion and button edges out of controls,
+            // so leave them there for the next request instead of dropping them
+            if (rb_full(&report_ring)) {
+                debug("report ring full");
+            } else {
+                struct mouse_state mouse = controls_mouse_read();
+                rb_push(&report_ring, &mouse);
+            }
+            sched_wake();
+        } else {
+            struct core1_call *call = (struct core1_call *)req;
+            call->fn(call->arg);
+            multicore_fifo_push_blocking(CORE1_CALL_DONE);
+        }
+    }
+}
+
+static void core1_sensor_run(void) {
+    if (boot_sensor_run() && boot_sensor_ok()) {
+        pmw_run();
+    }
+}
+
+static void core1_buttons_run(void);
+static void core1_job_run(void);
+
+enum core1_task {
+    CORE1_TASK_REQUESTS = 0,
+    CORE1_TASK_BUTTONS,
+    CORE1_TASK_PMW,
+    CORE1_TASK_JOB,
+
+    CORE1_TASK_COUNT
+};
+
+// requests of core 0 and button edges arrive with an event,
+// the sensor state machines are polled, jobs request their next step
+static struct sched_task core1_tasks[CORE1_TASK_COUNT] = {
+    [CORE1_TASK_REQUESTS] = SCHED_TASK(core1_handle_requests, 0, true, PROF_CORE1_REQUESTS),
+    [CORE1_TASK_BUTTONS] = SCHED_TASK(core1_buttons_run, 0, true, PROF_BUTTONS),
+    [CORE1_TASK_PMW] = SCHED_TASK(core1_sensor_run, 250, false, PROF_PMW),
+    [CORE1_TASK_JOB] = SCHED_TASK(core1_job_run, 0, false, PROF_CORE1_JOB),
+};
+
+static void core1_buttons_run(void) {
+    // come back when the pending debounce decision is due
+    sched_wake_at(&core1_tasks[CORE1_TASK_BUTTONS], buttons_run());
+}
+
+static void core1_job_run(void) {
+    if (job_current == NULL) {
+        return;
+    }
+
+    int r = job_current->run(job_current->arg);
+    if (r == 1) {
+        sched_wake_at(&core1_tasks[CORE1_TASK_JOB], time_us_64() + CORE1_JOB_STEP_US);
+        return;
+    }
+
+    // ring has room for every job that can be in flight
+    job_current->result = r;
+    rb_push(&job_ring, &job_current);
+    job_current = NULL;
+    sched_wake();
+}
+
+static void core1_job_begin(void *arg) {
+    struct core1_job *job = arg;
+    if ((job_current != NULL) || rb_full(&job_ring)) {
+        job->result = -1;
+        return;
+    }
+
+    job->result = job->start(job->arg);
+    if (job->result < 0) {
+        return;
+    }
+
+    job->result = 1;
+    job_current = job;
+    sched_wake_at(&core1_tasks[CORE1_TASK_JOB], time_us_64());
+}
+
+static void core1_main(void) {
+    // allow core 0 to pause us while writing to flash
+    multicore_lockout_victim_init();
+
+    // button interrupts have to be enabled on this core
+    buttons_init();
+
+    sched_loop(core1_tasks, count_of(core1_tasks));
+}
+
+void core1_init(void) {
+    multicore_launch_core1(core1_main);
+}
+
+void core1_run(void) {
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    if (core1_ticks != last_ticks) {
+        last_ticks = core1_ticks;
+        last_tick_change = now;
+    }
+}
+
+bool core1_alive(void) {
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    return (now - last_tick_change) < CORE1_ALIVE_TIMEOUT_MS;
+}
+
+void core1_call(void (*fn)(void *arg), void *arg) {
+    struct core1_call call = { .fn = fn, .arg = arg };
+    uintptr_t req = (uintptr_t)&call;
+
+    while (!rb_push(&request_ring, &req)) {
+        log_run();
+        watchdog_update();
+    }
+    sched_wake();
+
+    // keep output of core 1 flowing while it is busy
+    while (!multicore_fifo_rvalid()) {
+        log_run();
+        watchdog_update();
+    }
+
+    uint32_t r = multicore_fifo_pop_blocking();
+    if (r != CORE1_CALL_DONE) {
+        debug("unexpected message 0x%08lX", r);
+    }
+    log_run();
+}
+
+bool core1_job_start(struct core1_job *job) {
+    core1_call(core1_job_begin, job);
+    return job->result == 1;
+}
+
+struct core1_job *core1_job_done(void) {
+    struct core1_job *job;
+    if (!rb_pop(&job_ring, &job)) {
+        return NULL;
+    }
+    return job;
+}
+
+bool core1_request_report(void) {
+    uintptr_t req = CORE1_REQ_REPORT;
+    bool r = rb_push(&request_ring, &req);
+    sched_wake();
+    return r;
+}
+
+bool core1_get_report(struct mouse_state *mouse) {
+    return rb_pop(&report_ring, mouse);
+}
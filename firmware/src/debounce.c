@@ -0,0 +1,119 @@
+/*
+ * debounce.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "debounce.h"
+
+#define DEBOUNCE_DELAY_US (DEBOUNCE_DELAY_MS * 1000)
+
+void debounce_init(struct debounce *d, bool state, uint32_t now) {
+    d->first_edge = now;
+    d->last_edge = now;
+    d->current = state;
+    d->last = state;
+    d->settling = false;
+    d->holdoff = false;
+    d->holdoff_start = now;
+}
+
+enum debounce_result debounce_edge(struct debounce *d, enum button_debounce mode,
+                                   bool state, uint32_t time) {
+    if (state == d->last) {
+        return DEBOUNCE_UNCHANGED;
+    }
+
+    // start of a new transition, everything until it settles is bounce,
+    // even when it briefly returns to the reported level
+    if (!d->settling) {
+        d->first_edge = time;
+        d->settling = true;
+    }
+
+    d->last_edge = time;
+    d->last = state;
+
+    if ((mode == BUTTON_DEBOUNCE_EAGER) && !d->holdoff && (state != d->current)) {
+        d->current = state;
+        d->holdoff = true;
+        d->holdoff_start = time;
+        return DEBOUNCE_REPORT;
+    }
+
+    return DEBOUNCE_BOUNCING;
+}
+
+static uint32_t debounce_deferred(struct debounce *d, uint32_t now,
+                                  enum debounce_result *result, uint32_t *bounce) {
+    if (!d->settling) {
+        return UINT32_MAX;
+    }
+
+    uint32_t stable = now - d->last_edge;
+    if (stable <= DEBOUNCE_DELAY_US) {
+        return DEBOUNCE_DELAY_US - stable + 1;
+    }
+    d->settling = false;
+    *bounce = d->last_edge - d->first_edge;
+
+    // may have ended where it started, eg. a glitch while held
+    if (d->last != d->current) {
+        d->current = d->last;
+        *result = DEBOUNCE_REPORT;
+    }
+    return UINT32_MAX;
+}
+
+static uint32_t debounce_eager(struct debounce *d, uint32_t now,
+                               enum debounce_result *result, uint32_t *bounce) {
+    if (!d->holdoff) {
+        return UINT32_MAX;
+    }
+
+    uint32_t elapsed = now - d->holdoff_start;
+    if (elapsed <= DEBOUNCE_DELAY_US) {
+        return DEBOUNCE_DELAY_US - elapsed + 1;
+    }
+    d->holdoff = false;
+    d->settling = false;
+
+    // edges during the hold-off were bounce
+    uint32_t b = d->last_edge - d->holdoff_start;
+    *bounce = (b <= elapsed) ? b : 0;
+
+    // level changed again during the hold-off, eg. a very short tap
+    if (d->last != d->current) {
+        d->current = d->last;
+        d->holdoff = true;
+        d->holdoff_start = now;
+        *result = DEBOUNCE_REPORT;
+        return DEBOUNCE_DELAY_US + 1;
+    }
+
+    return UINT32_MAX;
+}
+
+uint32_t debounce_poll(struct debounce *d, enum button_debounce mode, uint32_t now,
+                       enum debounce_result *result, uint32_t *bounce) {
+    *result = DEBOUNCE_UNCHANGED;
+    *bounce = UINT32_MAX;
+
+    if (mode == BUTTON_DEBOUNCE_EAGER) {
+        return debounce_eager(d, now, result, bounce);
+    }
+    return debounce_deferred(d, now, result, bounce);
+}
@@ -23,6 +23,9 @@
 #include "config.h"
 #include "log.h"
 #include "pmw3360.h"
+#include "latency.h"
+#include "buttons.h"
+#include "core1.h"
 #include "debug.h"
 
 static FATFS fs;
@@ -61,6 +64,14 @@ int debug_msc_unmount(void) {
     return 0;
 }
 
+static char status_buff[3072];
+
+// reads sensor registers, so has to run on core 1
+static void debug_pmw_status(void *arg) {
+    (void)arg;
+    pmw_print_status(status_buff, sizeof(status_buff));
+}
+
 static void debug_msc_pmw_stats(void) {
     FIL file;
     FRESULT res = f_open(&file, "pmw_stats.txt", FA_CREATE_ALWAYS | FA_WRITE);
@@ -69,9 +80,9 @@ static void debug_msc_pmw_stats(void) {
         return;
     }
 
-    char status_buff[1024];
-    pmw_print_status(status_buff, sizeof(status_buff));
+    core1_call(debug_pmw_status, NULL);
     size_t len = strlen(status_buff);
+    len += latency_print(status_buff + len, sizeof(status_buff) - len);
 
     UINT bw;
     res = f_write(&file, status_buff, len, &bw);
@@ -85,28 +96,53 @@ static void debug_msc_pmw_stats(void) {
     }
 }
 
+static void debug_msc_button_stats(void) {
+    FIL file;
+    FRESULT res = f_open(&file, "button_wear.txt", FA_CREATE_ALWAYS | FA_WRITE);
+    if (res != FR_OK) {
+        debug("error: f_open returned %d", res);
+        return;
+    }
+
+    static char wear_buff[768];
+    size_t len = buttons_wear_print(wear_buff, sizeof(wear_buff));
+
+    UINT bw;
+    res = f_write(&file, wear_buff, len, &bw);
+    if ((res != FR_OK) || (bw != len)) {
+        debug("error: f_write returned %d", res);
+    }
+
+    res = f_close(&file);
+    if (res != FR_OK) {
+        debug("error: f_close returned %d", res);
+    }
+}
+
 void debug_msc_stats(void) {
     debug_msc_pmw_stats();
+    debug_msc_button_stats();
     log_dump_to_disk();
 }
 
-static void debug_msc_pmw3360_frame(void) {
+static void debug_msc_pmw3360_data(size_t samples) {
     FIL file;
-    FRESULT res = f_open(&file, "pmw_frame.bin", FA_CREATE_ALWAYS | FA_WRITE);
+    FRESULT res = f_open(&file, "pmw_data.csv", FA_CREATE_ALWAYS | FA_WRITE);
     if (res != FR_OK) {
         debug("error: f_open returned %d", res);
         return;
     }
 
-    uint8_t frame[PMW_FRAME_CAPTURE_LEN];
-    ssize_t r = pmw_frame_capture(frame, PMW_FRAME_CAPTURE_LEN);
-    if (r != PMW_FRAME_CAPTURE_LEN) {
-        debug("error: pmw_frame_capture %d != %d", r, PMW_FRAME_CAPTURE_LEN);
-    } else {
+    // line 0 is the header
+    for (size_t i = 0; i <= samples; i++) {
+        char line[100];
+        size_t len = pmw_dump_print(i, line, sizeof(line));
+
         UINT bw;
-        res = f_write(&file, frame, r, &bw);
-        if ((res != FR_OK) || ((ssize_t)bw != r)) {
+        res = f_write(&file, line, len, &bw);
+        if ((res != FR_OK) || (bw != len)) {
             debug("error: f_write returned %d", res);
+            break;
         }
     }
 
@@ -116,7 +152,32 @@ static void debug_msc_pmw3360_frame(void) {
     }
 }
 
-void debug_msc_pmw3360(void) {
-    pmw_dump_data(false);
-    debug_msc_pmw3360_frame();
+static void debug_msc_pmw3360_frame(const uint8_t *frame, ssize_t len) {
+    if (len != PMW_FRAME_CAPTURE_LEN) {
+        debug("error: frame capture %d != %d", len, PMW_FRAME_CAPTURE_LEN);
+        return;
+    }
+
+    FIL file;
+    FRESULT res = f_open(&file, "pmw_frame.bin", FA_CREATE_ALWAYS | FA_WRITE);
+    if (res != FR_OK) {
+        debug("error: f_open returned %d", res);
+        return;
+    }
+
+    UINT bw;
+    res = f_write(&file, frame, len, &bw);
+    if ((res != FR_OK) || ((ssize_t)bw != len)) {
+        debug("error: f_write returned %d", res);
+    }
+
+    res = f_close(&file);
+    if (res != FR_OK) {
+        debug("error: f_close returned %d", res);
+    }
+}
+
+void debug_msc_pmw3360(size_t samples, const uint8_t *frame, ssize_t frame_len) {
+    debug_msc_pmw3360_data(samples);
+    debug_msc_pmw3360_frame(frame, frame_len);
 }
@@ -31,14 +31,18 @@
 
 static uint8_t disk[DISK_BLOCK_COUNT * DISK_BLOCK_SIZE];
 
-void fat_disk_init(void) {
+int fat_disk_format(void) {
     BYTE work[FF_MAX_SS];
     FRESULT res = f_mkfs("", 0, work, sizeof(work));
     if (res != FR_OK) {
         debug("error: f_mkfs returned %d", res);
-        return;
+        return -1;
     }
 
+    return 0;
+}
+
+void fat_disk_populate(void) {
     if (debug_msc_mount() != 0) {
         debug("error mounting disk");
         return;
@@ -48,7 +52,7 @@ void fat_disk_init(void) {
     f_setlabel("DEBUG DISK");
 
     FIL file;
-    res = f_open(&file, "README.md", FA_CREATE_ALWAYS | FA_WRITE);
+    FRESULT res = f_open(&file, "README.md", FA_CREATE_ALWAYS | FA_WRITE);
     if (res != FR_OK) {
         debug("error: f_open returned %d", res);
     } else {
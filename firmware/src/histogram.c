@@ -0,0 +1,82 @@
+/*
+ * histogram.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+
+#include "config.h"
+#include "histogram.h"
+
+void histogram_add(struct histogram *h, uint32_t value) {
+    uint32_t bucket = value / h->bucket_width;
+    if (bucket >= HISTOGRAM_BUCKETS) {
+        bucket = HISTOGRAM_BUCKETS - 1;
+    }
+    h->buckets[bucket]++;
+
+    h->count++;
+    h->sum += value;
+    if (value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+void histogram_reset(struct histogram *h) {
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        h->buckets[i] = 0;
+    }
+    h->count = 0;
+    h->min = UINT32_MAX;
+    h->max = 0;
+    h->sum = 0;
+}
+
+uint32_t histogram_percentile(const struct histogram *h, uint32_t pct) {
+    if (h->count == 0) {
+        return 0;
+    }
+
+    uint64_t target = ((uint64_t)h->count * pct + 99) / 100;
+    uint64_t sum = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        sum += h->buckets[i];
+        if (sum >= target) {
+            uint32_t edge = (i + 1) * h->bucket_width;
+            return MIN(edge, h->max);
+        }
+    }
+    return h->max;
+}
+
+size_t histogram_print(const struct histogram *h, char *buff, size_t len) {
+    size_t pos = 0;
+
+    if (h->count == 0) {
+        pos += snprintf(buff + pos, len - pos, "%16s: no data\r\n", h->name);
+        return pos;
+    }
+
+    pos += snprintf(buff + pos, len - pos,
+            "%16s: n=%lu min=%lu%s avg=%llu%s p99=%lu%s max=%lu%s\r\n",
+            h->name, h->count, h->min, h->unit, h->sum / h->count, h->unit,
+            histogram_percentile(h, 99), h->unit, h->max, h->unit);
+    return pos;
+}
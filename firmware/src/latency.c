@@ -0,0 +1,56 @@
+/*
+ * latency.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+
+#include "config.h"
+#include "histogram.h"
+#include "latency.h"
+
+static struct histogram latency[LAT_STAGE_COUNT] = {
+    [LAT_BURST_DONE] = HISTOGRAM_INIT("burst done", 10),
+    [LAT_CONTROLS_READ] = HISTOGRAM_INIT("controls read", 250),
+    [LAT_REPORT_QUEUED] = HISTOGRAM_INIT("report queued", 250),
+    [LAT_REPORT_COMPLETE] = HISTOGRAM_INIT("report complete", 250),
+};
+
+void latency_add(enum latency_stage stage, uint64_t irq_time_us) {
+    uint64_t now = time_us_64();
+    if ((stage >= LAT_STAGE_COUNT) || (irq_time_us == 0) || (irq_time_us > now)) {
+        return;
+    }
+
+    uint64_t diff = now - irq_time_us;
+    histogram_add(&latency[stage], (diff > UINT32_MAX) ? UINT32_MAX : diff);
+}
+
+void latency_reset(void) {
+    for (int i = 0; i < LAT_STAGE_COUNT; i++) {
+        histogram_reset(&latency[i]);
+    }
+}
+
+size_t latency_print(char *buff, size_t len) {
+    size_t pos = 0;
+    pos += snprintf(buff + pos, len - pos, "Latency since MOTION interrupt:\r\n");
+    for (int i = 0; i < LAT_STAGE_COUNT; i++) {
+        pos += histogram_print(&latency[i], buff + pos, len - pos);
+    }
+    return pos;
+}
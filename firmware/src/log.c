@@ -18,21 +18,37 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "pico/stdlib.h"
 #include "hardware/watchdog.h"
 #include "ff.h"
 
 #include "config.h"
+#include "ring.h"
+#include "sched.h"
 #include "usb.h"
 #include "usb_cdc.h"
 #include "log.h"
 
+#define LOG_CHUNK_LEN 62
+#define LOG_CORE1_CHUNKS 32
+
+// output of core 1 is handed to core 0, which owns USB and the log buffer
+struct log_chunk {
+    uint8_t len;
+    bool log;
+    char text[LOG_CHUNK_LEN];
+};
+
 static char log_buff[4096];
 static size_t head = 0, tail = 0;
 static bool full = false;
 static bool got_input = false;
 
+static struct log_chunk core1_buff[LOG_CORE1_CHUNKS];
+static struct ring_buffer core1_ring = RB_INIT(core1_buff, LOG_CORE1_CHUNKS, sizeof(struct log_chunk));
+
 static void add_to_log(const char *buff, int len) {
     for (int i = 0; i < len; i++) {
         log_buff[head] = buff[i];
@@ -120,19 +136,54 @@ static int format_debug_log(char *buff, size_t len, const char *format, va_list
     return l;
 }
 
+static void log_core1_push(const char *buff, int len, bool log) {
+    struct log_chunk chunk;
+    chunk.log = log;
+
+    for (int pos = 0; pos < len; pos += LOG_CHUNK_LEN) {
+        chunk.len = MIN(len - pos, LOG_CHUNK_LEN);
+        memcpy(chunk.text, buff + pos, chunk.len);
+
+        // core 0 is always draining, even while waiting for core 1
+        while (!rb_push(&core1_ring, &chunk)) {
+            sched_wake();
+        }
+    }
+
+    sched_wake();
+}
+
+void log_run(void) {
+    struct log_chunk chunk;
+    while (rb_pop(&core1_ring, &chunk)) {
+        usb_cdc_write(chunk.text, chunk.len);
+
+        if (chunk.log) {
+            add_to_log(chunk.text, chunk.len);
+        }
+    }
+}
+
 void debug_log(bool log, const char* format, ...) {
-    static char line_buff[512];
+    static char line_buff[2][512]; // one for each core
+
+    uint core = get_core_num();
 
     va_list args;
     va_start(args, format);
-    int l = format_debug_log(line_buff, sizeof(line_buff), format, args);
+    int l = format_debug_log(line_buff[core], sizeof(line_buff[core]), format, args);
     va_end(args);
 
-    if ((l > 0) && (l <= (int)sizeof(line_buff))) {
-        usb_cdc_write(line_buff, l);
+    if ((l > 0) && (l <= (int)sizeof(line_buff[core]))) {
+        if (core != 0) {
+            log_core1_push(line_buff[core], l, log);
+            return;
+        }
+
+        usb_cdc_write(line_buff[core], l);
 
         if (log) {
-            add_to_log(line_buff, l);
+            add_to_log(line_buff[core], l);
         }
     }
 }
@@ -25,13 +25,44 @@
 #include "log.h"
 #include "usb.h"
 #include "pmw3360.h"
-#include "fat_disk.h"
 #include "buttons.h"
 #include "controls.h"
+#include "boot.h"
+#include "settings.h"
+#include "work.h"
+#include "core1.h"
+#include "sched.h"
+
+static void main_watchdog(void) {
+    core1_run();
+    if (core1_alive()) {
+        watchdog_update();
+    }
+}
+
+static void main_boot(void) {
+    boot_run();
+}
+
+// USB, deferred work and output of core 1 are driven by interrupts and
+// events, the rest by deadlines. Tasks run in this order on every pass.
+static struct sched_task main_tasks[] = {
+    SCHED_TASK(main_watchdog, 10 * 1000, false, PROF_WATCHDOG),
+    SCHED_TASK(heartbeat_run, HEARTBEAT_INTERVAL_MS * 1000, false, PROF_HEARTBEAT),
+    SCHED_TASK(usb_run, 1000, true, PROF_USB),
+    SCHED_TASK(work_run, 0, true, PROF_WORK),
+    SCHED_TASK(log_run, 0, true, PROF_LOG),
+    SCHED_TASK(cnsl_run, 10 * 1000, false, PROF_CONSOLE),
+    SCHED_TASK(main_boot, 1000, false, PROF_BOOT),
+    SCHED_TASK(buttons_wear_run, 1000 * 1000, false, PROF_BUTTON_WEAR),
+};
 
 int main(void) {
+    boot_mark(BOOT_EV_MAIN);
+
+    settings_init();
+    work_init();
     heartbeat_init();
-    buttons_init();
     controls_init();
 
     cnsl_init();
@@ -41,34 +72,13 @@ int main(void) {
         debug("reset by watchdog");
     }
 
-    debug("fat_disk_init");
-    fat_disk_init();
+    // sensor, buttons and mouse reports are handled by core 1
+    core1_init();
 
-    debug("pmw_init");
-    bool use_pmw = true;
-    if (pmw_init() != 0) {
-        debug("error initializing PMW3360");
-        use_pmw = false;
-    }
-
-    // trigger after 500ms
-    // (PMW3360 initialization takes ~160ms)
+    // disk and sensor are initialized step by step in the main loops,
+    // so USB can already enumerate in the meantime
+    // (each step takes less than 50ms)
     watchdog_enable(500, 1);
 
-    debug("init done");
-
-    while (1) {
-        watchdog_update();
-
-        heartbeat_run();
-        buttons_run();
-        usb_run();
-        cnsl_run();
-
-        if (use_pmw) {
-            pmw_run();
-        }
-    }
-
-    return 0;
+    sched_loop(main_tasks, count_of(main_tasks));
 }
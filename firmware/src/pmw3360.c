@@ -34,26 +34,161 @@
 #include <stdio.h>
 #include "pico/stdlib.h"
 #include "pico/binary_info.h"
-#include "hardware/spi.h"
+#include "hardware/sync.h"
 #include "hardware/watchdog.h"
-#include "ff.h"
 
 #include "config.h"
 #include "log.h"
 #include "util.h"
+#include "ring.h"
+#include "latency.h"
 #include "pmw3360_registers.h"
 #include "pmw3360_srom.h"
+#include "pmw3360_spi.h"
+#include "pmw3360_power.h"
+#include "settings.h"
 #include "pmw3360.h"
 
 #define HEALTH_CHECK_INTERVAL_MS 1000
+#define HEALTH_STALE_MS (PMW_HEALTH_QUIET_MS + 2 * HEALTH_CHECK_INTERVAL_MS)
+#define PMW_SAMPLE_RING_SIZE 64
+#define PMW_DATA_DUMP_TIMEOUT_MS (30 * 1000)
+#define PMW_FRAME_CHUNK 64 // bytes read per pmw_frame_capture_run()
+
+static struct pmw_sample sample_buff[PMW_SAMPLE_RING_SIZE];
+static struct ring_buffer sample_ring = RB_INIT(sample_buff, PMW_SAMPLE_RING_SIZE, sizeof(struct pmw_sample));
+static int32_t sample_overflow_x = 0, sample_overflow_y = 0;
+static uint64_t sample_overflows = 0;
+static uint64_t irq_time = 0;
+
+static volatile bool pmw_irq_active = false;
+static bool pmw_init_done = false;
+static uint8_t current_sensitivity = DEFAULT_MOUSE_SENSITIVITY;
+static int8_t current_angle = DEFAULT_MOUSE_ANGLE;
+
+enum pmw_init_state {
+    PMW_INIT_IDLE = 0,
+    PMW_INIT_WARM_CHECK,
+    PMW_INIT_POWER_UP,
+    PMW_INIT_SROM_ENABLE,
+    PMW_INIT_SROM_START,
+    PMW_INIT_SROM_LOAD,
+    PMW_INIT_CHECKSUM,
+    PMW_INIT_CHECKSUM_READ,
+    PMW_INIT_CONFIGURE,
+    PMW_INIT_DONE,
+    PMW_INIT_ERROR,
+};
+
+static enum pmw_init_state init_state = PMW_INIT_IDLE;
+static absolute_time_t init_wait;
+static uint8_t init_srom_id = 0;
+static uint16_t init_srom_checksum = 0;
+static bool init_srom_loaded = false;
+static bool init_power_up_allowed = true; // when the SROM is gone after a warm start
+static uint32_t last_health_check = 0;
 
-#if !defined(spi_default) || !defined(PICO_DEFAULT_SPI_SCK_PIN) || !defined(PICO_DEFAULT_SPI_TX_PIN) || !defined(PICO_DEFAULT_SPI_RX_PIN) || !defined(PICO_DEFAULT_SPI_CSN_PIN)
-#error PMW3360 API requires a board with SPI pins
-#endif
+static struct pmw_motion_report irq_motion_report;
+static struct pmw_op motion_op = { .done = true };
 
-static volatile int32_t delta_x = 0, delta_y = 0;
-static volatile bool mouse_motion = false;
-static uint32_t last_health_check = 0;
+/*
+ * MOTION is edge triggered and reads are rate limited to one per
+ * PMW_MOTION_MIN_INTERVAL_US. Edges arriving in between are coalesced
+ * into a deferred read, the sensor keeps accumulating the deltas.
+ */
+static volatile alarm_id_t motion_deferred = -1; // pending alarm when > 0
+static alarm_pool_t *motion_alarm_pool = NULL; // callbacks on the sensor core
+static uint64_t motion_last_read = 0;
+static uint64_t motion_pending_time = 0;
+
+/*
+ * Sensor health is derived from the SROM_RUN bit of each motion burst.
+ * The product ID is only probed explicitly when there was no motion
+ * for PMW_HEALTH_QUIET_MS, or when a burst looked suspicious.
+ * The status only reports this state, and asks for a probe when stale.
+ */
+static struct pmw_op health_op[2] = { { .done = true }, { .done = true } };
+static bool health_check_pending = false;
+static bool health_probe_requested = false;
+static volatile bool health_suspect = false;
+static volatile uint32_t health_last_motion = 0;
+static volatile uint32_t health_last_ok = 0; // SROM_RUN seen or probe passed, in ms
+static uint64_t health_probe_start = 0;
+
+struct pmw_health_stats {
+    uint64_t passive_ok;
+    uint64_t passive_fail;
+    uint32_t probes;
+    uint32_t probe_fail;
+    uint32_t probe_last_us;
+    uint32_t probe_max_us;
+    uint64_t probe_total_us;
+    bool probe_last_ok;
+    uint32_t probe_last_ms; // when it finished
+};
+
+static struct pmw_health_stats health_stats = { 0 };
+
+/*
+ * A data dump records the motion bursts of normal operation,
+ * so tracking continues meanwhile. A frame capture takes over
+ * the sensor and has to re-initialize it afterwards, the same
+ * as a re-initialization requested by the user.
+ */
+struct pmw_dump_sample {
+    uint32_t time_us;
+    struct pmw_motion_report report;
+};
+
+static struct pmw_dump_sample dump_buff[PMW_DATA_DUMP_SAMPLES];
+static volatile size_t dump_count = 0;
+static volatile bool dump_active = false;
+static uint32_t dump_start = 0;
+
+enum pmw_debug_state {
+    PMW_DEBUG_IDLE = 0,
+    PMW_DEBUG_FRAME_WAIT,
+    PMW_DEBUG_FRAME_READ,
+    PMW_DEBUG_REINIT,
+};
+
+static enum pmw_debug_state debug_state = PMW_DEBUG_IDLE;
+static absolute_time_t frame_wait;
+static uint8_t *frame_buff = NULL;
+static size_t frame_pos = 0;
+
+/*
+ * When the sensor stops responding, recovery is attempted with
+ * increasingly invasive steps. Rebooting the whole MCU, and with it
+ * re-enumerating USB, is only the last resort.
+ */
+enum pmw_recovery_level {
+    PMW_RECOVER_NONE = 0,
+    PMW_RECOVER_SPI_RESYNC,
+    PMW_RECOVER_SOFT_INIT,
+    PMW_RECOVER_POWER_UP,
+    PMW_RECOVER_REBOOT,
+    PMW_RECOVER_LEVELS
+};
+
+static const char *recovery_names[PMW_RECOVER_LEVELS] = {
+    "none",
+    "spi resync",
+    "soft init",
+    "power-up",
+    "reboot",
+};
+
+struct pmw_recovery_stats {
+    uint32_t attempts;
+    uint32_t success;
+    uint32_t last_us;
+    uint32_t max_us;
+};
+
+static enum pmw_recovery_level recovery_level = PMW_RECOVER_NONE;
+static uint64_t recovery_start = 0;
+static struct pmw_recovery_stats recovery_stats[PMW_RECOVER_LEVELS] = { 0 };
 
 #ifdef PMW_IRQ_COUNTERS
 static uint64_t pmw_irq_count_all = 0;
@@ -65,18 +200,50 @@ static uint64_t pmw_irq_count_run = 0;
 static uint64_t pmw_irq_count_rest1 = 0;
 static uint64_t pmw_irq_count_rest2 = 0;
 static uint64_t pmw_irq_count_rest3 = 0;
+static uint64_t pmw_irq_count_coalesced = 0;
+static uint32_t pmw_reads_window = 0;
+static uint64_t pmw_reads_window_start = 0;
+static uint32_t pmw_reads_per_sec = 0;
+static uint32_t pmw_reads_per_sec_max = 0;
 #endif // PMW_IRQ_COUNTERS
 
 void pmw_print_status(char *buff, size_t len) {
     size_t pos = 0;
 
-    bool com = pmw_is_alive();
-    if (com) {
-        pos += snprintf(buff + pos, len - pos, "Communication to PMW3360 is working\r\n");
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    uint32_t age = now - health_last_ok;
+    if (recovery_level != PMW_RECOVER_NONE) {
+        pos += snprintf(buff + pos, len - pos, "ERROR: PMW3360 not responding, trying %s\r\n",
+                recovery_names[recovery_level]);
+    } else if (age <= HEALTH_STALE_MS) {
+        pos += snprintf(buff + pos, len - pos, "PMW3360 is working, confirmed %lums ago\r\n", age);
     } else {
-        pos += snprintf(buff + pos, len - pos, "ERROR: can not communicate to PMW3360\r\n");
+        // eg. while a capture has stopped the sensor
+        health_probe_requested = true;
+        pos += snprintf(buff + pos, len - pos, "PMW3360 not confirmed for %lums, probing\r\n", age);
+    }
+
+    pos += snprintf(buff + pos, len - pos, "Health statistics:\r\n");
+    pos += snprintf(buff + pos, len - pos, "  passive_ok = %llu\r\n", health_stats.passive_ok);
+    pos += snprintf(buff + pos, len - pos, "passive_fail = %llu\r\n", health_stats.passive_fail);
+    pos += snprintf(buff + pos, len - pos, "      probes = %lu\r\n", health_stats.probes);
+    pos += snprintf(buff + pos, len - pos, "  probe_fail = %lu\r\n", health_stats.probe_fail);
+    pos += snprintf(buff + pos, len - pos, "probe_result = %s, %lums ago\r\n",
+            health_stats.probe_last_ok ? "ok" : "failed", now - health_stats.probe_last_ms);
+    pos += snprintf(buff + pos, len - pos, "  probe_last = %luus\r\n", health_stats.probe_last_us);
+    pos += snprintf(buff + pos, len - pos, "   probe_max = %luus\r\n", health_stats.probe_max_us);
+    pos += snprintf(buff + pos, len - pos, "   probe_avg = %lluus\r\n",
+            (health_stats.probes > 0) ? (health_stats.probe_total_us / health_stats.probes) : 0);
+
+    pos += snprintf(buff + pos, len - pos, "Recovery statistics:\r\n");
+    for (int i = PMW_RECOVER_SPI_RESYNC; i < PMW_RECOVER_LEVELS; i++) {
+        pos += snprintf(buff + pos, len - pos, "%10s: %lu / %lu ok, last %luus, max %luus\r\n",
+                recovery_names[i], recovery_stats[i].success, recovery_stats[i].attempts,
+                recovery_stats[i].last_us, recovery_stats[i].max_us);
     }
 
+    pos += pmw_power_print_status(buff + pos, len - pos);
+
 #ifdef PMW_IRQ_COUNTERS
     pos += snprintf(buff + pos, len - pos, "Interrupt statistics:\r\n");
     pos += snprintf(buff + pos, len - pos, "    pmw_irq_cnt_all = %llu\r\n", pmw_irq_count_all);
@@ -88,267 +255,236 @@ void pmw_print_status(char *buff, size_t len) {
     pos += snprintf(buff + pos, len - pos, "  pmw_irq_cnt_rest1 = %llu\r\n", pmw_irq_count_rest1);
     pos += snprintf(buff + pos, len - pos, "  pmw_irq_cnt_rest2 = %llu\r\n", pmw_irq_count_rest2);
     pos += snprintf(buff + pos, len - pos, "  pmw_irq_cnt_rest3 = %llu\r\n", pmw_irq_count_rest3);
+    pos += snprintf(buff + pos, len - pos, "pmw_irq_cnt_coalesc = %llu\r\n", pmw_irq_count_coalesced);
+    pos += snprintf(buff + pos, len - pos, "  pmw_reads_per_sec = %lu\r\n", pmw_reads_per_sec);
+    pos += snprintf(buff + pos, len - pos, "pmw_reads_per_s_max = %lu\r\n", pmw_reads_per_sec_max);
+    pos += snprintf(buff + pos, len - pos, "  pmw_smpl_overflow = %llu\r\n", sample_overflows);
+
+    struct pmw_spi_stats spi_stats = pmw_spi_get_stats();
+    pos += snprintf(buff + pos, len - pos, "SPI statistics:\r\n");
+    pos += snprintf(buff + pos, len - pos, "     pmw_spi_ops = %llu\r\n", spi_stats.ops);
+    pos += snprintf(buff + pos, len - pos, "   pmw_spi_rearm = %llu\r\n", spi_stats.rearm);
+    pos += snprintf(buff + pos, len - pos, "pmw_spi_max_queue = %lu\r\n", spi_stats.max_queue);
 #endif // PMW_IRQ_COUNTERS
 }
 
-struct pmw_motion pmw_get(void) {
-    struct pmw_motion r;
-    r.motion = mouse_motion;
-    r.delta_x = 0;
-    r.delta_y = 0;
-
-    if (r.motion) {
-        gpio_set_irq_enabled(PMW_MOTION_PIN, GPIO_IRQ_LEVEL_LOW, false);
-
-        r.delta_x = delta_x;
-        r.delta_y = delta_y;
-        delta_x = 0;
-        delta_y = 0;
-
-        gpio_set_irq_enabled(PMW_MOTION_PIN, GPIO_IRQ_LEVEL_LOW, true);
-    }
-
-    return r;
-}
-
-static inline void pmw_cs_select() {
-    asm volatile("nop \n nop \n nop");
-    gpio_put(PICO_DEFAULT_SPI_CSN_PIN, 0); // Active low
-    asm volatile("nop \n nop \n nop");
+bool pmw_get_sample(struct pmw_sample *sample) {
+    return rb_pop(&sample_ring, sample);
 }
 
-static inline void pmw_cs_deselect() {
-    asm volatile("nop \n nop \n nop");
-    gpio_put(PICO_DEFAULT_SPI_CSN_PIN, 1);
-    asm volatile("nop \n nop \n nop");
-}
-
-static void pmw_write_register(uint8_t reg, uint8_t data) {
-    pmw_cs_select();
-
-    reg |= WRITE_BIT;
-    spi_write_blocking(spi_default, &reg, 1);
-
-    busy_wait_us(15);
-
-    spi_write_blocking(spi_default, &data, 1);
-
-    busy_wait_us(20);
-    pmw_cs_deselect();
-    busy_wait_us(100);
-}
-
-static uint8_t pmw_read_register(uint8_t reg) {
-    pmw_cs_select();
-
-    reg &= ~WRITE_BIT;
-    spi_write_blocking(spi_default, &reg, 1);
-
-    busy_wait_us(160);
-
-    uint8_t buf = 0;
-    spi_read_blocking(spi_default, 0, &buf, 1);
-
-    busy_wait_us(1);
-    pmw_cs_deselect();
-    busy_wait_us(20);
-
-    return buf;
-}
-
-static void pmw_write_register_burst(uint8_t reg, const uint8_t *buf, uint16_t len) {
-    pmw_cs_select();
-
-    reg |= WRITE_BIT;
-    spi_write_blocking(spi_default, &reg, 1);
-
-    busy_wait_us(15);
+static void pmw_handle_motion_report(const struct pmw_motion_report *motion_report, uint64_t time_us) {
+#ifdef PMW_IRQ_COUNTERS
+    pmw_irq_count_all++;
 
-    for (uint16_t i = 0; i < len; i++) {
-        spi_write_blocking(spi_default, buf + i, 1);
-        busy_wait_us(15);
+    if (motion_report->motion & (1 << REG_MOTION_MOT)) {
+        pmw_irq_count_motion++;
+    } else {
+        pmw_irq_count_no_motion++;
     }
 
-    pmw_cs_deselect();
-
-    busy_wait_us(1);
-}
-
-static void pmw_read_register_burst(uint8_t reg, uint8_t *buf, uint16_t len) {
-    pmw_cs_select();
-
-    reg &= ~WRITE_BIT;
-    spi_write_blocking(spi_default, &reg, 1);
-
-    busy_wait_us(35);
-
-    spi_read_blocking(spi_default, 0, buf, len);
-
-    pmw_cs_deselect();
-    busy_wait_us(1);
-}
+    if (motion_report->motion & (1 << REG_MOTION_LIFT)) {
+        pmw_irq_count_lifted++;
+    } else {
+        pmw_irq_count_on_surface++;
+    }
 
-static uint8_t pmw_srom_download(void) {
-    // Write 0 to Rest_En bit of Config2 register to disable Rest mode
-    pmw_write_register(REG_CONFIG2, 0x00);
+    if ((motion_report->motion & (1 << REG_MOTION_OP_1))
+            && (motion_report->motion & (1 << REG_MOTION_OP_2))) {
+        pmw_irq_count_rest3++;
+    } else if (motion_report->motion & (1 << REG_MOTION_OP_1)) {
+        pmw_irq_count_rest1++;
+    } else if (motion_report->motion & (1 << REG_MOTION_OP_2)) {
+        pmw_irq_count_rest2++;
+    } else {
+        pmw_irq_count_run++;
+    }
+#endif // PMW_IRQ_COUNTERS
 
-    // Write 0x1d to SROM_Enable register for initializing
-    pmw_write_register(REG_SROM_ENABLE, 0x1D);
+    pmw_power_sample(motion_report->motion, time_us);
 
-    // Wait for 10 ms
-    busy_wait_ms(10);
+    if (dump_active && (dump_count < PMW_DATA_DUMP_SAMPLES)) {
+        dump_buff[dump_count].time_us = time_us;
+        dump_buff[dump_count].report = *motion_report;
+        dump_count++;
+    }
 
-    // Write 0x18 to SROM_Enable register again to start SROM Download
-    pmw_write_register(REG_SROM_ENABLE, 0x18);
+    if (motion_report->observation & (1 << REG_OBSERVATION_SROM_RUN)) {
+        health_stats.passive_ok++;
+        health_last_motion = time_us / 1000;
+        health_last_ok = health_last_motion;
+    } else {
+        health_stats.passive_fail++;
+        health_suspect = true;
+    }
 
-    busy_wait_us(120);
+    uint16_t delta_x_raw = motion_report->delta_x_l | (motion_report->delta_x_h << 8);
+    uint16_t delta_y_raw = motion_report->delta_y_l | (motion_report->delta_y_h << 8);
 
-    // Write SROM file into SROM_Load_Burst register, 1st data must start with SROM_Load_Burst address.
-    pmw_write_register_burst(REG_SROM_LOAD_BURST, pmw_fw_data, pmw_fw_length);
+    struct pmw_sample sample;
+    sample.time_us = time_us;
+    sample.delta_x = convert_two_complement(delta_x_raw) + sample_overflow_x;
+    sample.delta_y = convert_two_complement(delta_y_raw) + sample_overflow_y;
+    sample.motion = motion_report->motion;
+    sample.observation = motion_report->observation;
+    sample.squal = motion_report->squal;
 
-    busy_wait_us(200);
+    latency_add(LAT_BURST_DONE, time_us);
 
-    // Read the SROM_ID register to verify the ID before any other register reads or writes
-    uint8_t srom_id = pmw_read_register(REG_SROM_ID);
-    return srom_id;
+    if (rb_push(&sample_ring, &sample)) {
+        sample_overflow_x = 0;
+        sample_overflow_y = 0;
+    } else {
+        // keep movement for the next sample that fits
+        sample_overflow_x = sample.delta_x;
+        sample_overflow_y = sample.delta_y;
+        sample_overflows++;
+    }
 }
 
-static uint8_t pmw_power_up(void) {
-    pmw_cs_deselect();
-    pmw_cs_select();
-    pmw_cs_deselect();
+static void pmw_motion_request(void);
 
-    // Write 0x5A to Power_Up_Reset register
-    pmw_write_register(REG_POWER_UP_RESET, 0x5A);
+static void pmw_motion_done(struct pmw_op *op) {
+    (void)op;
 
-    // Wait for at least 50ms
-    busy_wait_ms(50);
+    pmw_handle_motion_report(&irq_motion_report, irq_time);
 
-    // Read from registers 0x02, 0x03, 0x04, 0x05 and 0x06 one time
-    for (uint8_t reg = REG_MOTION; reg <= REG_DELTA_Y_H; reg++) {
-        pmw_read_register(reg);
+    // MOTION is only released by the burst when there is no new
+    // movement yet, otherwise we would never see another edge
+    if (pmw_irq_active && !gpio_get(PMW_MOTION_PIN)) {
+        motion_pending_time = time_us_64();
+        pmw_motion_request();
     }
-
-    // Perform SROM download
-    uint8_t srom_id = pmw_srom_download();
-    return srom_id;
-}
-
-static struct pmw_motion_report pmw_motion_read(void) {
-    // Write any value to Motion_Burst register
-    pmw_write_register(REG_MOTION_BURST, 0x42);
-
-    // Start reading SPI Data continuously up to 12 bytes
-    struct pmw_motion_report motion_report;
-    pmw_read_register_burst(REG_MOTION_BURST, (uint8_t *)&motion_report, sizeof(motion_report));
-
-    return motion_report;
 }
 
-static uint16_t pmw_srom_checksum(void) {
-    pmw_write_register(REG_SROM_ENABLE, 0x15);
+static int64_t pmw_motion_deferred(alarm_id_t id, void *user_data) {
+    (void)id;
+    (void)user_data;
 
-    // Wait for at least 10 ms
-    busy_wait_ms(10);
-
-    uint16_t data = pmw_read_register(REG_DATA_OUT_LOWER);
-    data |= pmw_read_register(REG_DATA_OUT_UPPER) << 8;
-    return data;
+    motion_deferred = -1;
+    if (pmw_irq_active) {
+        pmw_motion_request();
+    }
+    return 0;
 }
 
-static void pmw_spi_init(void) {
-    // Use SPI0 at 2MHz
-    spi_init(spi_default, 2 * 1000 * 1000);
-    gpio_set_function(PICO_DEFAULT_SPI_RX_PIN, GPIO_FUNC_SPI);
-    gpio_set_function(PICO_DEFAULT_SPI_SCK_PIN, GPIO_FUNC_SPI);
-    gpio_set_function(PICO_DEFAULT_SPI_TX_PIN, GPIO_FUNC_SPI);
-
-    // Chip select is active-low, so we'll initialise it to a driven-high state
-    gpio_init(PICO_DEFAULT_SPI_CSN_PIN);
-    gpio_set_dir(PICO_DEFAULT_SPI_CSN_PIN, GPIO_OUT);
-    gpio_put(PICO_DEFAULT_SPI_CSN_PIN, 1);
-
-    spi_set_format(spi_default,
-                   8, // Number of bits per transfer
-                   1, // Polarity (CPOL)
-                   1, // Phase (CPHA)
-                   SPI_MSB_FIRST);
-
-    // make the SPI pins available to picotool
-    bi_decl(bi_3pins_with_func(PICO_DEFAULT_SPI_RX_PIN, PICO_DEFAULT_SPI_TX_PIN, PICO_DEFAULT_SPI_SCK_PIN, GPIO_FUNC_SPI));
-    bi_decl(bi_1pin_with_name(PICO_DEFAULT_SPI_CSN_PIN, "SPI CS"));
+// returns true when the read has been scheduled for later
+static bool pmw_motion_defer(uint64_t us) {
+    // alarm must not fire before its id is stored
+    uint32_t irq = save_and_disable_interrupts();
+    alarm_id_t id = alarm_pool_add_alarm_in_us(motion_alarm_pool, us, pmw_motion_deferred, NULL, false);
+    motion_deferred = (id > 0) ? id : -1; // 0 is already due, -1 no free alarm
+    restore_interrupts(irq);
+    return id > 0;
 }
 
-static void pmw_handle_interrupt(void) {
-    struct pmw_motion_report motion_report = pmw_motion_read();
-
+static void pmw_motion_request(void) {
+    if ((!motion_op.done) || (motion_deferred > 0)) {
+        // already busy, movement ends up in the next report
 #ifdef PMW_IRQ_COUNTERS
-    pmw_irq_count_all++;
+        pmw_irq_count_coalesced++;
+#endif // PMW_IRQ_COUNTERS
+        return;
+    }
 
-    if (motion_report.motion & (1 << REG_MOTION_MOT)) {
-        pmw_irq_count_motion++;
-    } else {
-        pmw_irq_count_no_motion++;
+    uint64_t now = time_us_64();
+    uint64_t next = motion_last_read + PMW_MOTION_MIN_INTERVAL_US;
+    if ((now < next) && (motion_alarm_pool != NULL)) {
+        if (pmw_motion_defer(next - now)) {
+#ifdef PMW_IRQ_COUNTERS
+            pmw_irq_count_coalesced++;
+#endif // PMW_IRQ_COUNTERS
+            return;
+        }
+        // already due or no alarm available, read immediately instead
     }
 
-    if (motion_report.motion & (1 << REG_MOTION_LIFT)) {
-        pmw_irq_count_lifted++;
-    } else {
-        pmw_irq_count_on_surface++;
+    motion_last_read = now;
+    irq_time = motion_pending_time;
+
+    motion_op.type = PMW_OP_MOTION_BURST;
+    motion_op.buff = (uint8_t *)&irq_motion_report;
+    motion_op.callback = pmw_motion_done;
+    if (!pmw_spi_submit(&motion_op)) {
+        // queue is full, MOTION stays asserted so try again later,
+        // or from pmw_run() when there is no alarm left
+        pmw_motion_defer(PMW_MOTION_MIN_INTERVAL_US);
+        return;
     }
 
-    if ((motion_report.motion & (1 << REG_MOTION_OP_1))
-            && (motion_report.motion & (1 << REG_MOTION_OP_2))) {
-        pmw_irq_count_rest3++;
-    } else if (motion_report.motion & (1 << REG_MOTION_OP_1)) {
-        pmw_irq_count_rest1++;
-    } else if (motion_report.motion & (1 << REG_MOTION_OP_2)) {
-        pmw_irq_count_rest2++;
-    } else {
-        pmw_irq_count_run++;
+#ifdef PMW_IRQ_COUNTERS
+    if ((now - pmw_reads_window_start) >= 1000000) {
+        pmw_reads_per_sec = pmw_reads_window;
+        if (pmw_reads_per_sec > pmw_reads_per_sec_max) {
+            pmw_reads_per_sec_max = pmw_reads_per_sec;
+        }
+        pmw_reads_window = 0;
+        pmw_reads_window_start = now;
     }
+    pmw_reads_window++;
 #endif // PMW_IRQ_COUNTERS
-
-    uint16_t delta_x_raw = motion_report.delta_x_l | (motion_report.delta_x_h << 8);
-    uint16_t delta_y_raw = motion_report.delta_y_l | (motion_report.delta_y_h << 8);
-
-    delta_x += convert_two_complement(delta_x_raw);
-    delta_y += convert_two_complement(delta_y_raw);
-    mouse_motion = true;
 }
 
 static void pmw_motion_irq(void) {
-    if (gpio_get_irq_event_mask(PMW_MOTION_PIN) & GPIO_IRQ_LEVEL_LOW) {
-        gpio_acknowledge_irq(PMW_MOTION_PIN, GPIO_IRQ_LEVEL_LOW);
-        pmw_handle_interrupt();
+    if (gpio_get_irq_event_mask(PMW_MOTION_PIN) & GPIO_IRQ_EDGE_FALL) {
+        gpio_acknowledge_irq(PMW_MOTION_PIN, GPIO_IRQ_EDGE_FALL);
+
+        if (motion_op.done && (motion_deferred <= 0)) {
+            motion_pending_time = time_us_64();
+        }
+        pmw_motion_request();
     }
 }
 
 static void pmw_irq_start(void) {
-    gpio_set_irq_enabled(PMW_MOTION_PIN, GPIO_IRQ_LEVEL_LOW, true);
+    pmw_irq_active = true;
+    gpio_set_irq_enabled(PMW_MOTION_PIN, GPIO_IRQ_EDGE_FALL, true);
+
+    // the edge may already be gone when there was unread motion
+    if (!gpio_get(PMW_MOTION_PIN)) {
+        uint32_t irq = save_and_disable_interrupts();
+        motion_pending_time = time_us_64();
+        pmw_motion_request();
+        restore_interrupts(irq);
+    }
 }
 
 static void pmw_irq_stop(void) {
-    gpio_set_irq_enabled(PMW_MOTION_PIN, GPIO_IRQ_LEVEL_LOW, false);
+    pmw_irq_active = false;
+    gpio_set_irq_enabled(PMW_MOTION_PIN, GPIO_IRQ_EDGE_FALL, false);
+
+    uint32_t irq = save_and_disable_interrupts();
+    if (motion_deferred > 0) {
+        alarm_pool_cancel_alarm(motion_alarm_pool, motion_deferred);
+        motion_deferred = -1;
+    }
+    restore_interrupts(irq);
+
+    // let pending operations finish before using the bus directly
+    pmw_spi_wait_idle();
 }
 
 void pmw_set_sensitivity(uint8_t sens) {
+    static struct pmw_op op_y = { .done = true }, op_x = { .done = true };
+
     if (sens > 0x77) {
         debug("invalid sense, clamping (0x%X > 0x77)", sens);
         sens = 0x77;
     }
 
-    pmw_irq_stop();
+    // previous change may still be in progress
+    pmw_spi_wait(&op_y);
+    pmw_spi_wait(&op_x);
 
-    pmw_write_register(REG_CONFIG1, sens);
-    pmw_write_register(REG_CONFIG5, sens);
+    // restored when re-initializing
+    current_sensitivity = sens;
 
-    pmw_irq_start();
+    op_y = (struct pmw_op){ .type = PMW_OP_WRITE, .reg = REG_CONFIG1, .data = sens };
+    op_x = (struct pmw_op){ .type = PMW_OP_WRITE, .reg = REG_CONFIG5, .data = sens };
+    pmw_spi_queue(&op_y);
+    pmw_spi_queue(&op_x);
 }
 
 uint8_t pmw_get_sensitivity(void) {
-    pmw_irq_stop();
-
     uint8_t sense_y = pmw_read_register(REG_CONFIG1);
     uint8_t sense_x = pmw_read_register(REG_CONFIG5);
     if (sense_y != sense_x) {
@@ -356,26 +492,30 @@ uint8_t pmw_get_sensitivity(void) {
         pmw_write_register(REG_CONFIG5, sense_y);
     }
 
-    pmw_irq_start();
     return sense_y;
 }
 
+uint16_t pmw_get_cpi(void) {
+    return PMW_SENSE_TO_CPI(current_sensitivity);
+}
+
 void pmw_set_angle(int8_t angle) {
-    pmw_irq_stop();
+    static struct pmw_op op = { .done = true };
 
-    uint8_t tmp = *((uint8_t *)(&angle));
-    pmw_write_register(REG_ANGLE_TUNE, tmp);
+    // previous change may still be in progress
+    pmw_spi_wait(&op);
 
-    pmw_irq_start();
+    // restored when re-initializing
+    current_angle = angle;
+
+    uint8_t tmp = *((uint8_t *)(&angle));
+    op = (struct pmw_op){ .type = PMW_OP_WRITE, .reg = REG_ANGLE_TUNE, .data = tmp };
+    pmw_spi_queue(&op);
 }
 
 int8_t pmw_get_angle(void) {
-    pmw_irq_stop();
-
     uint8_t tmp = pmw_read_register(REG_ANGLE_TUNE);
     int8_t angle = *((int8_t *)(&tmp));
-
-    pmw_irq_start();
     return angle;
 }
 
@@ -386,6 +526,9 @@ static void pmw_irq_init(void) {
         // setup MOTION pin interrupt to handle reading data
         gpio_add_raw_irq_handler(PMW_MOTION_PIN, pmw_motion_irq);
         irq_set_enabled(IO_IRQ_BANK0, true);
+
+        // the default pool runs its callbacks on core 0
+        motion_alarm_pool = alarm_pool_create_with_unused_hardware_alarm(4);
         first_init = true;
     }
 
@@ -397,7 +540,6 @@ static void pmw_irq_init(void) {
 
 bool pmw_is_alive(void) {
     bool r = true;
-    gpio_set_irq_enabled(PMW_MOTION_PIN, GPIO_IRQ_LEVEL_LOW, false);
 
     uint8_t prod_id = pmw_read_register(REG_PRODUCT_ID);
     uint8_t inv_prod_id = pmw_read_register(REG_INVERSE_PRODUCT_ID);
@@ -405,184 +547,514 @@ bool pmw_is_alive(void) {
         r = false;
     }
 
-    gpio_set_irq_enabled(PMW_MOTION_PIN, GPIO_IRQ_LEVEL_LOW, true);
     return r;
 }
 
-ssize_t pmw_frame_capture(uint8_t *buff, size_t buffsize) {
-    if ((buffsize < PMW_FRAME_CAPTURE_LEN) || (buff == NULL)) {
-        debug("invalid or too small buffer (%u < %u)", buffsize, PMW_FRAME_CAPTURE_LEN);
+static int pmw_configure(void) {
+    uint8_t prod_id = pmw_read_register(REG_PRODUCT_ID);
+    uint8_t inv_prod_id = pmw_read_register(REG_INVERSE_PRODUCT_ID);
+
+#ifdef PMW_PRINT_IDS
+    uint8_t rev_id = pmw_read_register(REG_REVISION_ID);
+
+    debug("SROM ID: 0x%02X", init_srom_id);
+    debug("Product ID: 0x%02X", prod_id);
+    debug("~ Prod. ID: 0x%02X", inv_prod_id);
+    debug("Revision ID: 0x%02X", rev_id);
+    debug("SROM CRC: 0x%04X", init_srom_checksum);
+#endif // PMW_PRINT_IDS
+
+    if (prod_id != ((~inv_prod_id) & 0xFF)) {
+        debug("SPI communication error (0x%02X != ~0x%02X)", prod_id, inv_prod_id);
         return -1;
     }
 
-    pmw_irq_stop();
+    if ((init_srom_id != pmw_fw_id) || (init_srom_checksum != pmw_fw_crc)) {
+        if (init_srom_id != pmw_fw_id) {
+            debug("PMW3360 error: invalid SROM ID (0x%02X != 0x%02X)", init_srom_id, pmw_fw_id);
+        }
 
-    // write 0 to Rest_En bit of Config2 register to disable Rest mode
+        if (init_srom_checksum != pmw_fw_crc) {
+            debug("PMW3360 error: invalid SROM CRC (0x%04X != 0x%04X)", init_srom_checksum, pmw_fw_crc);
+        }
+
+        debug("this may require a power-cycle to fix!");
+        return -1;
+    }
+
+    // Write 0x00 to Config2 register, rest mode is enabled by the power profile
     pmw_write_register(REG_CONFIG2, 0x00);
 
-    // write 0x83 to Frame_Capture register
-    pmw_write_register(REG_FRAME_CAPTURE, 0x83);
+    // Set sensitivity for each axis
+    pmw_write_register(REG_CONFIG2, pmw_read_register(REG_CONFIG2) | 0x04);
+    pmw_set_sensitivity(current_sensitivity);
 
-    // write 0xC5 to Frame_Capture register
-    pmw_write_register(REG_FRAME_CAPTURE, 0xC5);
+    // Set lift-detection threshold to 3mm (max)
+    pmw_write_register(REG_LIFT_CONFIG, 0x03);
 
-    // wait for 20ms
-    busy_wait_ms(20);
+    pmw_power_apply(settings_get()->pmw_profile);
+
+    pmw_set_angle(current_angle);
 
-    // continue burst read from Raw_data_Burst register until all 1296 raw data are transferred
-    pmw_read_register_burst(REG_RAW_DATA_BURST, buff, PMW_FRAME_CAPTURE_LEN);
+    pmw_irq_init();
 
-    return PMW_FRAME_CAPTURE_LEN;
+    return 0;
 }
 
-#define PMW_DATA_DUMP_SAMPLES 1000
+static void pmw_init_begin(bool warm, bool power_up_allowed) {
+    pmw_irq_stop();
+    pmw_spi_init();
+
+    init_srom_id = 0;
+    init_srom_checksum = 0;
+    init_srom_loaded = false;
+    init_power_up_allowed = power_up_allowed;
+    init_wait = get_absolute_time();
 
-#define PRINTRAW(fmt, ...) {                             \
-    if (serial) {                                        \
-        print(fmt, ##__VA_ARGS__);                       \
-    } else {                                             \
-        int n = snprintf(line, 100, fmt, ##__VA_ARGS__); \
-        UINT bw;                                         \
-        f_write(&file, line, n, &bw);                    \
-    }                                                    \
+    if (warm) {
+        // sensor may have stayed powered, check if SROM is still running
+        init_state = PMW_INIT_WARM_CHECK;
+    } else {
+        init_state = PMW_INIT_POWER_UP;
+    }
 }
 
-void pmw_dump_data(bool serial) {
-    char line[100];
-    FIL file;
-    if (!serial) {
-        FRESULT res = f_open(&file, "pmw_data.csv", FA_CREATE_ALWAYS | FA_WRITE);
-        if (res != FR_OK) {
-            debug("error: f_open returned %d", res);
-            return;
-        }
+// a warm start only re-configures, unless the SROM needs a download
+static enum pmw_init_state pmw_init_cold(void) {
+    if (!init_power_up_allowed) {
+        debug("SROM not running, leaving power-up to the next level");
+        return PMW_INIT_ERROR;
     }
+    return PMW_INIT_POWER_UP;
+}
 
-    struct pmw_motion_report buff[PMW_DATA_DUMP_SAMPLES];
+void pmw_init_start(void) {
+    pmw_init_begin(!pmw_init_done && watchdog_caused_reboot(), true);
+    pmw_init_done = true;
+}
 
-    println("Will now capture %u data samples from PMW3360", PMW_DATA_DUMP_SAMPLES);
-    println("Move trackball to generate some data!");
+int pmw_init_run(void) {
+    if (!time_reached(init_wait)) {
+        return 1;
+    }
 
-    pmw_irq_stop();
+    switch (init_state) {
+    case PMW_INIT_WARM_CHECK:
+        init_srom_id = pmw_read_register(REG_SROM_ID);
+        if (init_srom_id == pmw_fw_id) {
+            // still needs to be confirmed by checksum
+            init_srom_loaded = true;
+            init_state = PMW_INIT_CHECKSUM;
+        } else {
+            init_state = pmw_init_cold();
+        }
+        break;
+
+    case PMW_INIT_POWER_UP:
+        pmw_cs_deselect();
+        pmw_cs_select();
+        pmw_cs_deselect();
 
-    for (size_t i = 0; i < PMW_DATA_DUMP_SAMPLES; i++) {
-        // wait until MOTION pin is set
-        while (gpio_get(PMW_MOTION_PIN)) {
-            watchdog_update();
+        // Write 0x5A to Power_Up_Reset register
+        pmw_write_register(REG_POWER_UP_RESET, 0x5A);
+
+        // Wait for at least 50ms
+        init_wait = make_timeout_time_ms(50);
+        init_state = PMW_INIT_SROM_ENABLE;
+        break;
+
+    case PMW_INIT_SROM_ENABLE:
+        // Read from registers 0x02, 0x03, 0x04, 0x05 and 0x06 one time
+        for (uint8_t reg = REG_MOTION; reg <= REG_DELTA_Y_H; reg++) {
+            pmw_read_register(reg);
         }
 
-        buff[i] = pmw_motion_read();
-    }
+        // Write 0 to Rest_En bit of Config2 register to disable Rest mode
+        pmw_write_register(REG_CONFIG2, 0x00);
 
-    if (serial) {
-        println();
-    } else {
-        println("Now writing data");
+        // Write 0x1d to SROM_Enable register for initializing
+        pmw_write_register(REG_SROM_ENABLE, 0x1D);
+
+        // Wait for 10 ms
+        init_wait = make_timeout_time_ms(10);
+        init_state = PMW_INIT_SROM_START;
+        break;
+
+    case PMW_INIT_SROM_START:
+        // Write 0x18 to SROM_Enable register again to start SROM Download
+        pmw_write_register(REG_SROM_ENABLE, 0x18);
+
+        busy_wait_us(120);
+
+        // Write SROM file into SROM_Load_Burst register, 1st data must start with SROM_Load_Burst address.
+        pmw_write_register_burst_start(REG_SROM_LOAD_BURST, pmw_fw_data, pmw_fw_length);
+        init_state = PMW_INIT_SROM_LOAD;
+        break;
+
+    case PMW_INIT_SROM_LOAD:
+        if (pmw_write_register_burst_busy()) {
+            return 1;
+        }
+        pmw_write_register_burst_finish();
+
+        busy_wait_us(200);
+
+        // Read the SROM_ID register to verify the ID before any other register reads or writes
+        init_srom_id = pmw_read_register(REG_SROM_ID);
+        init_state = PMW_INIT_CHECKSUM;
+        break;
+
+    case PMW_INIT_CHECKSUM:
+        pmw_write_register(REG_SROM_ENABLE, 0x15);
+
+        // Wait for at least 10 ms
+        init_wait = make_timeout_time_ms(10);
+        init_state = PMW_INIT_CHECKSUM_READ;
+        break;
+
+    case PMW_INIT_CHECKSUM_READ:
+        init_srom_checksum = pmw_read_register(REG_DATA_OUT_LOWER);
+        init_srom_checksum |= pmw_read_register(REG_DATA_OUT_UPPER) << 8;
+
+        if (init_srom_loaded && (init_srom_checksum != pmw_fw_crc)) {
+            // SROM is not intact, needs the full power-up
+            init_srom_loaded = false;
+            init_state = pmw_init_cold();
+        } else {
+            if (init_srom_loaded) {
+                debug("SROM still loaded, skipping download");
+            }
+            init_state = PMW_INIT_CONFIGURE;
+        }
+        break;
+
+    case PMW_INIT_CONFIGURE:
+        if (pmw_configure() == 0) {
+            // product ID has been checked while configuring
+            health_last_ok = to_ms_since_boot(get_absolute_time());
+            init_state = PMW_INIT_DONE;
+        } else {
+            init_state = PMW_INIT_ERROR;
+        }
+        break;
+
+    case PMW_INIT_DONE:
+        return 0;
+
+    default:
+        return -1;
     }
 
-    PRINTRAW("time,motion,observation,delta_x,delta_y,squal,raw_sum,raw_max,raw_min,shutter\r\n");
+    return 1;
+}
 
-    for (size_t i = 0; i < PMW_DATA_DUMP_SAMPLES; i++) {
+int pmw_init(void) {
+    pmw_init_start();
+
+    // initializing takes a while (~160ms)
+    int r;
+    while ((r = pmw_init_run()) > 0) {
         watchdog_update();
+    }
+    return r;
+}
 
-        uint16_t delta_x_raw = buff[i].delta_x_l | (buff[i].delta_x_h << 8);
-        uint16_t delta_y_raw = buff[i].delta_y_l | (buff[i].delta_y_h << 8);
-        uint16_t shutter_raw = buff[i].shutter_lower | (buff[i].shutter_upper << 8);
+static void pmw_health_probe_done(struct pmw_op *op) {
+    (void)op;
 
-        PRINTRAW("%llu,", to_us_since_boot(get_absolute_time()));
-        PRINTRAW("%u,", buff[i].motion);
-        PRINTRAW("%u,", buff[i].observation);
-        PRINTRAW("%ld,", convert_two_complement(delta_x_raw));
-        PRINTRAW("%ld,", convert_two_complement(delta_y_raw));
-        PRINTRAW("%u,", buff[i].squal);
-        PRINTRAW("%u,", buff[i].raw_data_sum);
-        PRINTRAW("%u,", buff[i].maximum_raw_data);
-        PRINTRAW("%u,", buff[i].minimum_raw_data);
-        PRINTRAW("%u\r\n", shutter_raw);
+    uint32_t duration = time_us_64() - health_probe_start;
+    health_stats.probe_last_us = duration;
+    health_stats.probe_total_us += duration;
+    if (duration > health_stats.probe_max_us) {
+        health_stats.probe_max_us = duration;
     }
+}
 
-    if (serial) {
-        println();
+static void pmw_health_probe_start(void) {
+    // read IDs in the background, result is checked in a later call
+    health_probe_start = time_us_64();
+    health_op[0] = (struct pmw_op){ .type = PMW_OP_READ, .reg = REG_PRODUCT_ID };
+    health_op[1] = (struct pmw_op){ .type = PMW_OP_READ, .reg = REG_INVERSE_PRODUCT_ID,
+                                    .callback = pmw_health_probe_done };
+    pmw_spi_queue(&health_op[0]);
+    pmw_spi_queue(&health_op[1]);
+    health_stats.probes++;
+}
+
+static bool pmw_health_probe_ok(void) {
+    uint8_t prod_id = health_op[0].data;
+    uint8_t inv_prod_id = health_op[1].data;
+    bool ok = prod_id == ((~inv_prod_id) & 0xFF);
+
+    health_stats.probe_last_ok = ok;
+    health_stats.probe_last_ms = to_ms_since_boot(get_absolute_time());
+    if (ok) {
+        health_last_ok = health_stats.probe_last_ms;
     }
+    return ok;
+}
 
-    pmw_irq_start();
+static void pmw_recovery_start(enum pmw_recovery_level level) {
+    recovery_level = level;
+    recovery_start = time_us_64();
+    recovery_stats[level].attempts++;
+    debug("PMW3360 recovery: %s", recovery_names[level]);
+
+    switch (level) {
+    case PMW_RECOVER_SPI_RESYNC:
+        pmw_irq_stop();
+        pmw_spi_init();
+
+        // toggling NCS resets the serial port of the sensor
+        pmw_cs_deselect();
+        pmw_cs_select();
+        pmw_cs_deselect();
+
+        pmw_health_probe_start();
+        break;
+
+    case PMW_RECOVER_SOFT_INIT:
+        // fails on to PMW_RECOVER_POWER_UP when the SROM is gone
+        pmw_init_begin(true, false);
+        break;
+
+    case PMW_RECOVER_POWER_UP:
+        pmw_init_begin(false, true);
+        break;
+
+    default:
+        debug("PMW3360 is dead. resetting!");
+        reset_to_main();
+        break;
+    }
+}
+
+static void pmw_recovery_run(void) {
+    int r;
+    if (recovery_level == PMW_RECOVER_SPI_RESYNC) {
+        if (!health_op[0].done || !health_op[1].done) {
+            return;
+        }
 
-    if (!serial) {
-        FRESULT res = f_close(&file);
-        if (res != FR_OK) {
-            debug("error: f_close returned %d", res);
+        if (pmw_health_probe_ok()) {
+            pmw_irq_start();
+            r = 0;
+        } else {
+            health_stats.probe_fail++;
+            r = -1;
         }
+    } else {
+        r = pmw_init_run();
+        if (r > 0) {
+            return;
+        }
+    }
+
+    struct pmw_recovery_stats *stats = &recovery_stats[recovery_level];
+    stats->last_us = time_us_64() - recovery_start;
+    if (stats->last_us > stats->max_us) {
+        stats->max_us = stats->last_us;
+    }
+
+    if (r == 0) {
+        stats->success++;
+        debug("PMW3360 recovered with %s after %luus",
+                recovery_names[recovery_level], stats->last_us);
+        recovery_level = PMW_RECOVER_NONE;
+        last_health_check = to_ms_since_boot(get_absolute_time());
+        health_last_ok = last_health_check;
+    } else {
+        pmw_recovery_start(recovery_level + 1);
     }
 }
 
-int pmw_init(void) {
-    // initializing takes a while (~160ms)
-    watchdog_update();
+static bool pmw_busy(void) {
+    return dump_active || (debug_state != PMW_DEBUG_IDLE) || (recovery_level != PMW_RECOVER_NONE);
+}
 
-    pmw_irq_stop();
-    pmw_spi_init();
+int pmw_dump_start(void) {
+    if (pmw_busy()) {
+        return -1;
+    }
 
-    uint8_t srom_id = pmw_power_up();
-    uint8_t prod_id = pmw_read_register(REG_PRODUCT_ID);
-    uint8_t inv_prod_id = pmw_read_register(REG_INVERSE_PRODUCT_ID);
-    uint16_t srom_checksum = pmw_srom_checksum();
+    dump_count = 0;
+    dump_start = to_ms_since_boot(get_absolute_time());
+    dump_active = true;
+    return 0;
+}
 
-#ifdef PMW_PRINT_IDS
-    uint8_t rev_id = pmw_read_register(REG_REVISION_ID);
+int pmw_dump_run(void) {
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    if ((dump_count < PMW_DATA_DUMP_SAMPLES) && ((now - dump_start) < PMW_DATA_DUMP_TIMEOUT_MS)) {
+        return 1;
+    }
 
-    debug("SROM ID: 0x%02X", srom_id);
-    debug("Product ID: 0x%02X", prod_id);
-    debug("~ Prod. ID: 0x%02X", inv_prod_id);
-    debug("Revision ID: 0x%02X", rev_id);
-    debug("SROM CRC: 0x%04X", srom_checksum);
-#endif // PMW_PRINT_IDS
+    dump_active = false;
+    return dump_count;
+}
 
-    if (prod_id != ((~inv_prod_id) & 0xFF)) {
-        debug("SPI communication error (0x%02X != ~0x%02X)", prod_id, inv_prod_id);
-        return -1;
+size_t pmw_dump_print(size_t line, char *buff, size_t len) {
+    if (line == 0) {
+        return snprintf(buff, len, "time,motion,observation,delta_x,delta_y,squal,raw_sum,raw_max,raw_min,shutter\r\n");
     }
 
-    if ((srom_id != pmw_fw_id) || (srom_checksum != pmw_fw_crc)) {
-        if (srom_id != pmw_fw_id) {
-            debug("PMW3360 error: invalid SROM ID (0x%02X != 0x%02X)", srom_id, pmw_fw_id);
-        }
+    const struct pmw_dump_sample *s = &dump_buff[MIN(line, PMW_DATA_DUMP_SAMPLES) - 1];
+    uint16_t delta_x_raw = s->report.delta_x_l | (s->report.delta_x_h << 8);
+    uint16_t delta_y_raw = s->report.delta_y_l | (s->report.delta_y_h << 8);
+    uint16_t shutter_raw = s->report.shutter_lower | (s->report.shutter_upper << 8);
 
-        if (srom_checksum != pmw_fw_crc) {
-            debug("PMW3360 error: invalid SROM CRC (0x%04X != 0x%04X)", srom_checksum, pmw_fw_crc);
-        }
+    return snprintf(buff, len, "%lu,%u,%u,%ld,%ld,%u,%u,%u,%u,%u\r\n",
+                    s->time_us, s->report.motion, s->report.observation,
+                    convert_two_complement(delta_x_raw), convert_two_complement(delta_y_raw),
+                    s->report.squal, s->report.raw_data_sum,
+                    s->report.maximum_raw_data, s->report.minimum_raw_data, shutter_raw);
+}
 
-        debug("this may require a power-cycle to fix!");
+int pmw_frame_capture_start(uint8_t *buff, size_t buffsize) {
+    if ((buffsize < PMW_FRAME_CAPTURE_LEN) || (buff == NULL)) {
+        debug("invalid or too small buffer (%u < %u)", buffsize, PMW_FRAME_CAPTURE_LEN);
+        return -1;
+    }
+
+    if (pmw_busy()) {
         return -1;
     }
 
-    // Write 0x00 to Config2 register for wired mouse or 0x20 for wireless mouse design
-#ifdef PMW_FEATURE_WIRELESS
-    pmw_write_register(REG_CONFIG2, 0x20);
-#else // ! PMW_FEATURE_WIRELESS
+    pmw_irq_stop();
+
+    // write 0 to Rest_En bit of Config2 register to disable Rest mode
     pmw_write_register(REG_CONFIG2, 0x00);
-#endif // PMW_FEATURE_WIRELESS
 
-    // Set sensitivity for each axis
-    pmw_write_register(REG_CONFIG2, pmw_read_register(REG_CONFIG2) | 0x04);
-    pmw_set_sensitivity(DEFAULT_MOUSE_SENSITIVITY);
+    // write 0x83 to Frame_Capture register
+    pmw_write_register(REG_FRAME_CAPTURE, 0x83);
 
-    // Set lift-detection threshold to 3mm (max)
-    pmw_write_register(REG_LIFT_CONFIG, 0x03);
+    // write 0xC5 to Frame_Capture register
+    pmw_write_register(REG_FRAME_CAPTURE, 0xC5);
 
-    pmw_set_angle(DEFAULT_MOUSE_ANGLE);
+    // wait for 20ms
+    frame_wait = make_timeout_time_ms(20);
+    frame_buff = buff;
+    frame_pos = 0;
+    debug_state = PMW_DEBUG_FRAME_WAIT;
+    return 0;
+}
 
-    pmw_irq_init();
+static int pmw_reinit_step(void) {
+    int r = pmw_init_run();
+    if (r > 0) {
+        return 1;
+    }
+    debug_state = PMW_DEBUG_IDLE;
+
+    if (r < 0) {
+        debug("error re-initializing PMW3360");
+        pmw_recovery_start(PMW_RECOVER_POWER_UP);
+    }
+    return r;
+}
+
+ssize_t pmw_frame_capture_run(void) {
+    switch (debug_state) {
+    case PMW_DEBUG_FRAME_WAIT:
+        if (!time_reached(frame_wait)) {
+            return 1;
+        }
+        pmw_read_register_burst_start(REG_RAW_DATA_BURST);
+        debug_state = PMW_DEBUG_FRAME_READ;
+        return 1;
+
+    case PMW_DEBUG_FRAME_READ: {
+        // continue burst read from Raw_data_Burst register until all 1296 raw data are transferred
+        size_t n = MIN(PMW_FRAME_CHUNK, PMW_FRAME_CAPTURE_LEN - frame_pos);
+        pmw_read_register_burst_continue(frame_buff + frame_pos, n);
+        frame_pos += n;
+        if (frame_pos < PMW_FRAME_CAPTURE_LEN) {
+            return 1;
+        }
+        pmw_read_register_burst_finish();
+
+        // only a reset leaves frame capture mode
+        pmw_init_begin(false, true);
+        debug_state = PMW_DEBUG_REINIT;
+        return 1;
+    }
+
+    case PMW_DEBUG_REINIT:
+        if (pmw_reinit_step() > 0) {
+            return 1;
+        }
+        return PMW_FRAME_CAPTURE_LEN;
 
+    default:
+        return -1;
+    }
+}
+
+int pmw_reinit_start(void) {
+    if (pmw_busy()) {
+        return -1;
+    }
+
+    pmw_init_begin(false, true);
+    debug_state = PMW_DEBUG_REINIT;
     return 0;
 }
 
+int pmw_reinit_run(void) {
+    if (debug_state != PMW_DEBUG_REINIT) {
+        return -1;
+    }
+    return pmw_reinit_step();
+}
+
 void pmw_run(void) {
+    if (debug_state != PMW_DEBUG_IDLE) {
+        // a frame capture or re-initialization owns the sensor
+        return;
+    }
+
+    if (recovery_level != PMW_RECOVER_NONE) {
+        pmw_recovery_run();
+        return;
+    }
+
+    // a retry could not be scheduled, MOTION is still asserted
+    if (pmw_irq_active && !gpio_get(PMW_MOTION_PIN)) {
+        uint32_t irq = save_and_disable_interrupts();
+        if (motion_op.done && (motion_deferred <= 0)) {
+            motion_pending_time = time_us_64();
+            pmw_motion_request();
+        }
+        restore_interrupts(irq);
+    }
+
+    if (health_check_pending) {
+        if (!health_op[0].done || !health_op[1].done) {
+            return;
+        }
+        health_check_pending = false;
+
+        if (!pmw_health_probe_ok()) {
+            health_stats.probe_fail++;
+            debug("PMW3360 is not responding");
+            pmw_recovery_start(PMW_RECOVER_SPI_RESYNC);
+        }
+        return;
+    }
+
     uint32_t now = to_ms_since_boot(get_absolute_time());
-    if (now >= (last_health_check + HEALTH_CHECK_INTERVAL_MS)) {
-        last_health_check = now;
-        if (!pmw_is_alive()) {
-            debug("PMW3360 is dead. resetting!");
-            reset_to_main();
+    bool quiet = (now - health_last_motion) >= PMW_HEALTH_QUIET_MS;
+    bool due = (now - last_health_check) >= HEALTH_CHECK_INTERVAL_MS;
+
+    if (health_suspect || health_probe_requested || (quiet && due)) {
+        if (health_suspect) {
+            debug("SROM_RUN not set in motion burst, probing sensor");
         }
+        health_suspect = false;
+        health_probe_requested = false;
+        last_health_check = now;
+
+        pmw_health_probe_start();
+        health_check_pending = true;
     }
 }
@@ -0,0 +1,227 @@
+/*
+ * pmw3360_power.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "config.h"
+#include "log.h"
+#include "settings.h"
+#include "pmw3360_registers.h"
+#include "pmw3360_spi.h"
+#include "pmw3360_power.h"
+
+#define CONFIG2_REST_EN (1 << 5)
+
+/*
+ * Run downshift time = run_downshift * 10ms
+ * RestN frame period = (restN_rate + 1) * 1ms
+ * Rest1 downshift time = rest1_downshift * 320 * Rest1 frame period
+ * Rest2 downshift time = rest2_downshift * 32 * Rest2 frame period
+ */
+struct pmw_profile_regs {
+    const char *name;
+    bool rest_enable;
+    uint8_t run_downshift;
+    uint16_t rest1_rate;
+    uint8_t rest1_downshift;
+    uint16_t rest2_rate;
+    uint8_t rest2_downshift;
+    uint16_t rest3_rate;
+};
+
+static const struct pmw_profile_regs profiles[PMW_PROFILE_COUNT] = {
+    [PMW_PROFILE_COMPETITIVE] = {
+        .name = "competitive",
+        .rest_enable = false,
+        .run_downshift = 0x32, // 500ms
+        .rest1_rate = 0x0000, // 1ms
+        .rest1_downshift = 0x1F, // ~10s
+        .rest2_rate = 0x0063, // 100ms
+        .rest2_downshift = 0xBC, // ~10min
+        .rest3_rate = 0x01F3, // 500ms
+    },
+    [PMW_PROFILE_BALANCED] = {
+        .name = "balanced",
+        .rest_enable = true,
+        .run_downshift = 0x32, // 500ms
+        .rest1_rate = 0x0000, // 1ms
+        .rest1_downshift = 0x1F, // ~10s
+        .rest2_rate = 0x0063, // 100ms
+        .rest2_downshift = 0xBC, // ~10min
+        .rest3_rate = 0x01F3, // 500ms
+    },
+    [PMW_PROFILE_IDLE_SAVER] = {
+        .name = "idle-saver",
+        .rest_enable = true,
+        .run_downshift = 0x0A, // 100ms
+        .rest1_rate = 0x0001, // 2ms
+        .rest1_downshift = 0x04, // ~2.5s
+        .rest2_rate = 0x0063, // 100ms
+        .rest2_downshift = 0x13, // ~60s
+        .rest3_rate = 0x03E7, // 1s
+    },
+};
+
+static const char *mode_names[PMW_MODE_COUNT] = {
+    "run", "rest1", "rest2", "rest3",
+};
+
+struct pmw_mode_stats {
+    uint64_t residency_us;
+    uint32_t wakes; // motion first reported while in this mode
+    uint64_t wake_total_us; // until the sensor reported Run again
+    uint32_t wake_max_us;
+};
+
+static enum pmw_profile current_profile = PMW_PROFILE_COMPETITIVE;
+static uint64_t mode_durations_us[PMW_MODE_REST3] = { 0 };
+static struct pmw_mode_stats mode_stats[PMW_MODE_COUNT] = { 0 };
+static uint64_t last_sample_us = 0;
+static enum pmw_op_mode wake_mode = PMW_MODE_RUN;
+static uint64_t wake_start_us = 0;
+
+const char *pmw_profile_name(enum pmw_profile profile) {
+    if (profile >= PMW_PROFILE_COUNT) {
+        return "unknown";
+    }
+    return profiles[profile].name;
+}
+
+int pmw_profile_from_name(const char *name) {
+    for (int i = 0; i < PMW_PROFILE_COUNT; i++) {
+        if (strcmp(name, profiles[i].name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void pmw_power_apply(enum pmw_profile profile) {
+    if (profile >= PMW_PROFILE_COUNT) {
+        debug("invalid profile %d", profile);
+        profile = DEFAULT_PMW_PROFILE;
+    }
+
+    const struct pmw_profile_regs *p = &profiles[profile];
+
+    pmw_write_register(REG_RUN_DOWNSHIFT, p->run_downshift);
+    pmw_write_register(REG_REST1_RATE_LOWER, p->rest1_rate & 0xFF);
+    pmw_write_register(REG_REST1_RATE_UPPER, p->rest1_rate >> 8);
+    pmw_write_register(REG_REST1_DOWNSHIFT, p->rest1_downshift);
+    pmw_write_register(REG_REST2_RATE_LOWER, p->rest2_rate & 0xFF);
+    pmw_write_register(REG_REST2_RATE_UPPER, p->rest2_rate >> 8);
+    pmw_write_register(REG_REST2_DOWNSHIFT, p->rest2_downshift);
+    pmw_write_register(REG_REST3_RATE_LOWER, p->rest3_rate & 0xFF);
+    pmw_write_register(REG_REST3_RATE_UPPER, p->rest3_rate >> 8);
+
+    uint8_t config2 = pmw_read_register(REG_CONFIG2);
+    if (p->rest_enable) {
+        config2 |= CONFIG2_REST_EN;
+    } else {
+        config2 &= ~CONFIG2_REST_EN;
+    }
+    pmw_write_register(REG_CONFIG2, config2);
+
+    uint64_t rest1_period_us = (p->rest1_rate + 1) * 1000ULL;
+    uint64_t rest2_period_us = (p->rest2_rate + 1) * 1000ULL;
+    mode_durations_us[PMW_MODE_RUN] = p->run_downshift * 10000ULL;
+    mode_durations_us[PMW_MODE_REST1] = p->rest1_downshift * 320ULL * rest1_period_us;
+    mode_durations_us[PMW_MODE_REST2] = p->rest2_downshift * 32ULL * rest2_period_us;
+
+    current_profile = profile;
+}
+
+enum pmw_profile pmw_power_get_profile(void) {
+    return current_profile;
+}
+
+void pmw_power_set_profile(enum pmw_profile profile) {
+    pmw_power_apply(profile);
+
+    // saved by the caller, flash can only be written from core 0
+    settings_get()->pmw_profile = current_profile;
+}
+
+/*
+ * The sensor only reports while moving, so the time spent in
+ * each mode between two reports is derived from the programmed
+ * downshift timing.
+ */
+static void pmw_power_account(uint64_t idle_us) {
+    if (!profiles[current_profile].rest_enable) {
+        mode_stats[PMW_MODE_RUN].residency_us += idle_us;
+        return;
+    }
+
+    for (int i = PMW_MODE_RUN; (i < PMW_MODE_REST3) && (idle_us > 0); i++) {
+        uint64_t t = MIN(idle_us, mode_durations_us[i]);
+        mode_stats[i].residency_us += t;
+        idle_us -= t;
+    }
+    mode_stats[PMW_MODE_REST3].residency_us += idle_us;
+}
+
+void pmw_power_sample(uint8_t motion, uint64_t time_us) {
+    enum pmw_op_mode mode = (motion >> REG_MOTION_OP_1) & 0x03;
+
+    if (last_sample_us != 0) {
+        pmw_power_account(time_us - last_sample_us);
+    }
+    last_sample_us = time_us;
+
+    if (mode != PMW_MODE_RUN) {
+        if (wake_mode == PMW_MODE_RUN) {
+            // first report after resting
+            wake_mode = mode;
+            wake_start_us = time_us;
+        }
+    } else if (wake_mode != PMW_MODE_RUN) {
+        uint32_t wake_us = time_us - wake_start_us;
+        mode_stats[wake_mode].wakes++;
+        mode_stats[wake_mode].wake_total_us += wake_us;
+        if (wake_us > mode_stats[wake_mode].wake_max_us) {
+            mode_stats[wake_mode].wake_max_us = wake_us;
+        }
+        wake_mode = PMW_MODE_RUN;
+    }
+}
+
+size_t pmw_power_print_status(char *buff, size_t len) {
+    size_t pos = 0;
+
+    pos += snprintf(buff + pos, len - pos, "Power profile: %s\r\n", pmw_profile_name(current_profile));
+
+    uint64_t total = 0;
+    for (int i = 0; i < PMW_MODE_COUNT; i++) {
+        total += mode_stats[i].residency_us;
+    }
+
+    for (int i = 0; i < PMW_MODE_COUNT; i++) {
+        const struct pmw_mode_stats *s = &mode_stats[i];
+        pos += snprintf(buff + pos, len - pos,
+                "%6s: %llums (%llu%%), %lu wakes, avg %lluus, max %luus\r\n",
+                mode_names[i], s->residency_us / 1000,
+                (total > 0) ? (s->residency_us * 100 / total) : 0,
+                s->wakes, (s->wakes > 0) ? (s->wake_total_us / s->wakes) : 0,
+                s->wake_max_us);
+    }
+
+    return pos;
+}
@@ -0,0 +1,518 @@
+/*
+ * pmw3360_spi.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * Based on:
+ *  - PMW3360 Datasheet
+ *  - https://github.com/raspberrypi/pico-examples/blob/master/spi/bme280_spi/bme280_spi.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include "pico/stdlib.h"
+#include "pico/binary_info.h"
+#include "pico/critical_section.h"
+#include "hardware/spi.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/timer.h"
+#include "hardware/sync.h"
+
+#include "config.h"
+#include "pmw3360_registers.h"
+#include "pmw3360_spi.h"
+
+// minimum delays from the datasheet, in microseconds.
+// the alarm starts when a byte is put into the FIFO, so
+// schedules after a byte also have to wait for PMW_T_BYTE
+#define PMW_T_WRITE_ADDRESS 15 // address to data byte of a write
+#define PMW_T_SCLK_NCS_WRITE 20 // last data byte to NCS high of a write
+#define PMW_T_SWX 100 // write to next access (tSWW, tSWR)
+#define PMW_T_SRAD 160 // address to data byte of a read
+#define PMW_T_SRX 20 // read to next access (tSRW, tSRR)
+#define PMW_T_SRAD_MOTBR 35 // address to data byte of a motion burst
+#define PMW_T_BEXIT 1 // NCS high after burst
+#define PMW_T_BYTE 5 // one byte on the wire at 2MHz
+#define PMW_T_LOAD 15 // between bytes of a SROM download burst
+
+#define PMW_OP_QUEUE_SIZE 16
+
+#if !defined(spi_default) || !defined(PICO_DEFAULT_SPI_SCK_PIN) || !defined(PICO_DEFAULT_SPI_TX_PIN) || !defined(PICO_DEFAULT_SPI_RX_PIN) || !defined(PICO_DEFAULT_SPI_CSN_PIN)
+#error PMW3360 API requires a board with SPI pins
+#endif
+
+enum pmw_spi_phase {
+    PHASE_IDLE = 0,
+    PHASE_WRITE_ADDRESS,
+    PHASE_WRITE_DATA,
+    PHASE_WRITE_GUARD,
+    PHASE_READ_ADDRESS,
+    PHASE_READ_DATA,
+    PHASE_READ_GUARD,
+    PHASE_BURST_ADDRESS,
+    PHASE_BURST_DMA,
+};
+
+static struct pmw_op *queue[PMW_OP_QUEUE_SIZE];
+static volatile uint32_t queue_head = 0, queue_tail = 0;
+static struct pmw_op *volatile current = NULL;
+static volatile enum pmw_spi_phase phase = PHASE_IDLE;
+
+/*
+ * The sensor stays in burst mode after a Motion_Burst read, until
+ * any other register is accessed. Only then the Motion_Burst register
+ * has to be written again before the next burst read.
+ */
+static volatile bool burst_armed = false;
+
+static int spi_alarm = -1;
+static int dma_tx = -1, dma_rx = -1;
+static int dma_load = -1, dma_load_timer = -1;
+static const uint8_t dma_dummy = 0;
+
+static struct pmw_spi_stats stats = { 0 };
+static critical_section_t spi_lock;
+
+// placeholder for current while the bus is used directly
+static struct pmw_op raw_op;
+
+static void pmw_spi_next(void);
+
+void pmw_cs_select(void) {
+    asm volatile("nop \n nop \n nop");
+    gpio_put(PICO_DEFAULT_SPI_CSN_PIN, 0); // Active low
+    asm volatile("nop \n nop \n nop");
+}
+
+void pmw_cs_deselect(void) {
+    asm volatile("nop \n nop \n nop");
+    gpio_put(PICO_DEFAULT_SPI_CSN_PIN, 1);
+    asm volatile("nop \n nop \n nop");
+}
+
+static void pmw_spi_schedule(uint32_t us) {
+    if (hardware_alarm_set_target(spi_alarm, make_timeout_time_us(us))) {
+        // target is already in the past, fire right away
+        hardware_alarm_force_irq(spi_alarm);
+    }
+}
+
+static void pmw_spi_drain(void) {
+    // wait for last byte to be shifted out, then discard received data
+    while (spi_is_busy(spi_default)) {
+        tight_loop_contents();
+    }
+    while (spi_is_readable(spi_default)) {
+        (void)spi_get_hw(spi_default)->dr;
+    }
+}
+
+static void pmw_spi_finish(void) {
+    struct pmw_op *op = current;
+    current = NULL;
+    phase = PHASE_IDLE;
+
+    op->done = true;
+    if (op->callback) {
+        op->callback(op);
+    }
+
+    critical_section_enter_blocking(&spi_lock);
+    pmw_spi_next();
+    critical_section_exit(&spi_lock);
+}
+
+static void pmw_spi_start(struct pmw_op *op) {
+    current = op;
+    stats.ops++;
+    pmw_cs_select();
+
+    switch (op->type) {
+    case PMW_OP_READ:
+        burst_armed = false;
+        spi_get_hw(spi_default)->dr = op->reg & ~WRITE_BIT;
+        phase = PHASE_READ_ADDRESS;
+        pmw_spi_schedule(PMW_T_BYTE + PMW_T_SRAD);
+        break;
+
+    case PMW_OP_WRITE:
+        burst_armed = false;
+        spi_get_hw(spi_default)->dr = op->reg | WRITE_BIT;
+        phase = PHASE_WRITE_ADDRESS;
+        pmw_spi_schedule(PMW_T_BYTE + PMW_T_WRITE_ADDRESS);
+        break;
+
+    case PMW_OP_MOTION_BURST:
+        if (burst_armed) {
+            // still in burst mode, directly send Motion_Burst address
+            spi_get_hw(spi_default)->dr = REG_MOTION_BURST & ~WRITE_BIT;
+            phase = PHASE_BURST_ADDRESS;
+            pmw_spi_schedule(PMW_T_BYTE + PMW_T_SRAD_MOTBR);
+        } else {
+            // Write any value to Motion_Burst register first
+            stats.rearm++;
+            spi_get_hw(spi_default)->dr = REG_MOTION_BURST | WRITE_BIT;
+            phase = PHASE_WRITE_ADDRESS;
+            pmw_spi_schedule(PMW_T_BYTE + PMW_T_WRITE_ADDRESS);
+        }
+        break;
+    }
+}
+
+static void pmw_spi_next(void) {
+    if ((current != NULL) || (queue_head == queue_tail)) {
+        return;
+    }
+
+    struct pmw_op *op = queue[queue_tail];
+    queue_tail = (queue_tail + 1) % PMW_OP_QUEUE_SIZE;
+    pmw_spi_start(op);
+}
+
+static void pmw_spi_alarm(uint alarm_num) {
+    (void)alarm_num;
+    struct pmw_op *op = current;
+
+    switch (phase) {
+    case PHASE_WRITE_ADDRESS:
+        spi_get_hw(spi_default)->dr = (op->type == PMW_OP_MOTION_BURST) ? 0x42 : op->data;
+        phase = PHASE_WRITE_DATA;
+        pmw_spi_schedule(PMW_T_BYTE + PMW_T_SCLK_NCS_WRITE);
+        break;
+
+    case PHASE_WRITE_DATA:
+        pmw_spi_drain();
+        pmw_cs_deselect();
+        phase = PHASE_WRITE_GUARD;
+        pmw_spi_schedule(PMW_T_SWX);
+        break;
+
+    case PHASE_WRITE_GUARD:
+        if (op->type == PMW_OP_MOTION_BURST) {
+            // Lower NCS and send Motion_Burst address
+            pmw_cs_select();
+            spi_get_hw(spi_default)->dr = REG_MOTION_BURST & ~WRITE_BIT;
+            phase = PHASE_BURST_ADDRESS;
+            pmw_spi_schedule(PMW_T_BYTE + PMW_T_SRAD_MOTBR);
+        } else {
+            pmw_spi_finish();
+        }
+        break;
+
+    case PHASE_READ_ADDRESS:
+        pmw_spi_drain();
+        spi_get_hw(spi_default)->dr = 0;
+        phase = PHASE_READ_DATA;
+        pmw_spi_schedule(PMW_T_BYTE);
+        break;
+
+    case PHASE_READ_DATA:
+        while (spi_is_busy(spi_default) || !spi_is_readable(spi_default)) {
+            tight_loop_contents();
+        }
+        op->data = spi_get_hw(spi_default)->dr;
+        pmw_cs_deselect();
+        phase = PHASE_READ_GUARD;
+        pmw_spi_schedule(PMW_T_SRX);
+        break;
+
+    case PHASE_READ_GUARD:
+        pmw_spi_finish();
+        break;
+
+    case PHASE_BURST_ADDRESS:
+        // Start reading SPI Data continuously up to 12 bytes
+        pmw_spi_drain();
+        phase = PHASE_BURST_DMA;
+        dma_channel_set_write_addr(dma_rx, op->buff, false);
+        dma_channel_set_trans_count(dma_rx, sizeof(struct pmw_motion_report), false);
+        dma_channel_set_trans_count(dma_tx, sizeof(struct pmw_motion_report), false);
+        dma_start_channel_mask((1u << dma_rx) | (1u << dma_tx));
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void pmw_spi_dma_irq(void) {
+    if (!dma_channel_get_irq0_status(dma_rx)) {
+        return;
+    }
+    dma_channel_acknowledge_irq0(dma_rx);
+
+    pmw_cs_deselect();
+    busy_wait_us(PMW_T_BEXIT);
+
+    burst_armed = true;
+    pmw_spi_finish();
+}
+
+bool pmw_spi_submit(struct pmw_op *op) {
+    if (spi_alarm < 0) {
+        // not initialized yet, eg. console command while booting
+        op->data = 0;
+        op->done = true;
+        return true;
+    }
+
+    op->done = false;
+
+    // operations may be submitted from both cores
+    critical_section_enter_blocking(&spi_lock);
+
+    uint32_t next = (queue_head + 1) % PMW_OP_QUEUE_SIZE;
+    if (next == queue_tail) {
+        critical_section_exit(&spi_lock);
+        op->done = true;
+        return false;
+    }
+
+    queue[queue_head] = op;
+    queue_head = next;
+
+    uint32_t count = (queue_head + PMW_OP_QUEUE_SIZE - queue_tail) % PMW_OP_QUEUE_SIZE;
+    if (count > stats.max_queue) {
+        stats.max_queue = count;
+    }
+
+    pmw_spi_next();
+
+    critical_section_exit(&spi_lock);
+    return true;
+}
+
+void pmw_spi_queue(struct pmw_op *op) {
+    while (!pmw_spi_submit(op)) {
+        tight_loop_contents();
+    }
+}
+
+void pmw_spi_wait(struct pmw_op *op) {
+    while (!op->done) {
+        tight_loop_contents();
+    }
+}
+
+struct pmw_spi_stats pmw_spi_get_stats(void) {
+    return stats;
+}
+
+/*
+ * Direct bus access takes the place of the current operation,
+ * so anything submitted in the meantime waits in the queue.
+ */
+static void pmw_spi_claim(void) {
+    while (true) {
+        critical_section_enter_blocking(&spi_lock);
+        if (current == NULL) {
+            current = &raw_op;
+            critical_section_exit(&spi_lock);
+            break;
+        }
+        critical_section_exit(&spi_lock);
+        tight_loop_contents();
+    }
+
+    burst_armed = false;
+}
+
+static void pmw_spi_release(void) {
+    critical_section_enter_blocking(&spi_lock);
+    current = NULL;
+    pmw_spi_next();
+    critical_section_exit(&spi_lock);
+}
+
+bool pmw_spi_idle(void) {
+    return (current == NULL) && (queue_head == queue_tail);
+}
+
+void pmw_spi_wait_idle(void) {
+    while (!pmw_spi_idle()) {
+        tight_loop_contents();
+    }
+}
+
+void pmw_write_register(uint8_t reg, uint8_t data) {
+    struct pmw_op op = {
+        .type = PMW_OP_WRITE,
+        .reg = reg,
+        .data = data,
+    };
+    pmw_spi_queue(&op);
+    pmw_spi_wait(&op);
+}
+
+uint8_t pmw_read_register(uint8_t reg) {
+    struct pmw_op op = {
+        .type = PMW_OP_READ,
+        .reg = reg,
+    };
+    pmw_spi_queue(&op);
+    pmw_spi_wait(&op);
+    return op.data;
+}
+
+void pmw_read_motion_burst(uint8_t *buff) {
+    struct pmw_op op = {
+        .type = PMW_OP_MOTION_BURST,
+        .buff = buff,
+    };
+    pmw_spi_queue(&op);
+    pmw_spi_wait(&op);
+}
+
+void pmw_write_register_burst_start(uint8_t reg, const uint8_t *buf, uint16_t len) {
+    pmw_spi_claim();
+    pmw_cs_select();
+
+    reg |= WRITE_BIT;
+    spi_write_blocking(spi_default, &reg, 1);
+
+    busy_wait_us(PMW_T_LOAD);
+
+    // DMA timer paces the data bytes to one every tLOAD after the previous one
+    dma_channel_set_read_addr(dma_load, buf, false);
+    dma_channel_set_trans_count(dma_load, len, true);
+}
+
+bool pmw_write_register_burst_busy(void) {
+    return dma_channel_is_busy(dma_load);
+}
+
+void pmw_write_register_burst_finish(void) {
+    while (pmw_write_register_burst_busy()) {
+        tight_loop_contents();
+    }
+
+    // nobody was reading the RX FIFO during the transfer
+    pmw_spi_drain();
+    spi_get_hw(spi_default)->icr = SPI_SSPICR_RORIC_BITS;
+
+    // DMA is done when the last byte is in the FIFO, not on the wire
+    busy_wait_us(PMW_T_SCLK_NCS_WRITE);
+    pmw_cs_deselect();
+
+    busy_wait_us(PMW_T_SWX);
+    pmw_spi_release();
+}
+
+void pmw_write_register_burst(uint8_t reg, const uint8_t *buf, uint16_t len) {
+    pmw_write_register_burst_start(reg, buf, len);
+    pmw_write_register_burst_finish();
+}
+
+void pmw_read_register_burst_start(uint8_t reg) {
+    pmw_spi_claim();
+    pmw_cs_select();
+
+    reg &= ~WRITE_BIT;
+    spi_write_blocking(spi_default, &reg, 1);
+
+    busy_wait_us(PMW_T_SRAD_MOTBR);
+}
+
+void pmw_read_register_burst_continue(uint8_t *buf, uint16_t len) {
+    spi_read_blocking(spi_default, 0, buf, len);
+}
+
+void pmw_read_register_burst_finish(void) {
+    pmw_cs_deselect();
+    busy_wait_us(PMW_T_BEXIT);
+    pmw_spi_release();
+}
+
+void pmw_read_register_burst(uint8_t reg, uint8_t *buf, uint16_t len) {
+    pmw_read_register_burst_start(reg);
+    pmw_read_register_burst_continue(buf, len);
+    pmw_read_register_burst_finish();
+}
+
+void pmw_spi_init(void) {
+    static bool first_init = false;
+
+    // Use SPI0 at 2MHz
+    spi_init(spi_default, 2 * 1000 * 1000);
+    gpio_set_function(PICO_DEFAULT_SPI_RX_PIN, GPIO_FUNC_SPI);
+    gpio_set_function(PICO_DEFAULT_SPI_SCK_PIN, GPIO_FUNC_SPI);
+    gpio_set_function(PICO_DEFAULT_SPI_TX_PIN, GPIO_FUNC_SPI);
+
+    // Chip select is active-low, so we'll initialise it to a driven-high state
+    gpio_init(PICO_DEFAULT_SPI_CSN_PIN);
+    gpio_set_dir(PICO_DEFAULT_SPI_CSN_PIN, GPIO_OUT);
+    gpio_put(PICO_DEFAULT_SPI_CSN_PIN, 1);
+
+    spi_set_format(spi_default,
+                   8, // Number of bits per transfer
+                   1, // Polarity (CPOL)
+                   1, // Phase (CPHA)
+                   SPI_MSB_FIRST);
+
+    // make the SPI pins available to picotool
+    bi_decl(bi_3pins_with_func(PICO_DEFAULT_SPI_RX_PIN, PICO_DEFAULT_SPI_TX_PIN, PICO_DEFAULT_SPI_SCK_PIN, GPIO_FUNC_SPI));
+    bi_decl(bi_1pin_with_name(PICO_DEFAULT_SPI_CSN_PIN, "SPI CS"));
+
+    burst_armed = false;
+
+    if (first_init) {
+        return;
+    }
+    first_init = true;
+
+    critical_section_init(&spi_lock);
+
+    // alarm paces the delays between transfers,
+    // its interrupt is handled on the core calling this first
+    spi_alarm = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(spi_alarm, pmw_spi_alarm);
+
+    dma_tx = dma_claim_unused_channel(true);
+    dma_rx = dma_claim_unused_channel(true);
+
+    // clock out dummy bytes for each byte of a motion burst
+    dma_channel_config c = dma_channel_get_default_config(dma_tx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, spi_get_dreq(spi_default, true));
+    dma_channel_configure(dma_tx, &c, &spi_get_hw(spi_default)->dr,
+            &dma_dummy, sizeof(struct pmw_motion_report), false);
+
+    // and store the received report bytes
+    c = dma_channel_get_default_config(dma_rx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, spi_get_dreq(spi_default, false));
+    dma_channel_configure(dma_rx, &c, NULL,
+            &spi_get_hw(spi_default)->dr, sizeof(struct pmw_motion_report), false);
+
+    // paced transfer of SROM download bursts
+    dma_load = dma_claim_unused_channel(true);
+    dma_load_timer = dma_claim_unused_timer(true);
+    dma_timer_set_fraction(dma_load_timer, 1, clock_get_hz(clk_sys) / 1000000 * (PMW_T_LOAD + PMW_T_BYTE));
+
+    c = dma_channel_get_default_config(dma_load);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, dma_get_timer_dreq(dma_load_timer));
+    dma_channel_configure(dma_load, &c, &spi_get_hw(spi_default)->dr,
+            NULL, 0, false);
+
+    dma_channel_set_irq0_enabled(dma_rx, true);
+    irq_add_shared_handler(DMA_IRQ_0, pmw_spi_dma_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+}
@@ -0,0 +1,110 @@
+/*
+ * prof.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#ifdef MAIN_LOOP_PROFILER
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+
+#include "histogram.h"
+#include "prof.h"
+
+// SysTick wraps after about 134ms at 125MHz
+#define PROF_SYSTICK_MAX_US 100000
+
+static struct histogram tasks[PROF_TASK_COUNT] = {
+    [PROF_WATCHDOG] = HISTOGRAM_INIT_UNIT("watchdog", 125, "cyc"),
+    [PROF_HEARTBEAT] = HISTOGRAM_INIT_UNIT("heartbeat", 125, "cyc"),
+    [PROF_USB] = HISTOGRAM_INIT_UNIT("usb", 125, "cyc"),
+    [PROF_WORK] = HISTOGRAM_INIT_UNIT("work", 125, "cyc"),
+    [PROF_LOG] = HISTOGRAM_INIT_UNIT("log", 125, "cyc"),
+    [PROF_CONSOLE] = HISTOGRAM_INIT_UNIT("console", 125, "cyc"),
+    [PROF_BOOT] = HISTOGRAM_INIT_UNIT("boot", 125, "cyc"),
+    [PROF_BUTTON_WEAR] = HISTOGRAM_INIT_UNIT("button wear", 125, "cyc"),
+    [PROF_CORE1_REQUESTS] = HISTOGRAM_INIT_UNIT("core1 requests", 125, "cyc"),
+    [PROF_BUTTONS] = HISTOGRAM_INIT_UNIT("buttons", 125, "cyc"),
+    [PROF_PMW] = HISTOGRAM_INIT_UNIT("pmw", 125, "cyc"),
+    [PROF_CORE1_JOB] = HISTOGRAM_INIT_UNIT("core1 job", 125, "cyc"),
+};
+
+// time between the start of two loop iterations, per core
+static struct histogram loops[2] = {
+    HISTOGRAM_INIT("core0 loop", 5),
+    HISTOGRAM_INIT("core1 loop", 5),
+};
+static uint32_t loop_start[2] = { 0, 0 };
+
+void prof_add(enum prof_task task, uint32_t start_cycles, uint32_t start_us) {
+    // counts down
+    uint32_t cycles = (start_cycles - systick_hw->cvr) & M0PLUS_SYST_RVR_BITS;
+
+    uint32_t us = time_us_32() - start_us;
+    if (us > PROF_SYSTICK_MAX_US) {
+        cycles = us * (clock_get_hz(clk_sys) / 1000000);
+    }
+
+    histogram_add(&tasks[task], cycles);
+}
+
+void prof_loop(void) {
+    uint core = get_core_num();
+
+    // each core has its own SysTick
+    if (!(systick_hw->csr & M0PLUS_SYST_CSR_ENABLE_BITS)) {
+        systick_hw->rvr = M0PLUS_SYST_RVR_BITS;
+        systick_hw->cvr = 0;
+        systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+    }
+
+    uint32_t now = time_us_32();
+    if (loop_start[core] != 0) {
+        histogram_add(&loops[core], now - loop_start[core]);
+    }
+    loop_start[core] = now;
+}
+
+void prof_reset(void) {
+    for (int i = 0; i < PROF_TASK_COUNT; i++) {
+        histogram_reset(&tasks[i]);
+    }
+    for (int i = 0; i < 2; i++) {
+        histogram_reset(&loops[i]);
+        loop_start[i] = 0;
+    }
+}
+
+void prof_print(char *buff, size_t len) {
+    size_t pos = 0;
+
+    pos += snprintf(buff + pos, len - pos, "Task execution time:\r\n");
+    for (int i = 0; i < PROF_TASK_COUNT; i++) {
+        pos += histogram_print(&tasks[i], buff + pos, len - pos);
+        pos += snprintf(buff + pos, len - pos, "%16s  total=%llums\r\n", "",
+                        tasks[i].sum / (clock_get_hz(clk_sys) / 1000));
+    }
+
+    pos += snprintf(buff + pos, len - pos, "Loop iteration time:\r\n");
+    for (int i = 0; i < 2; i++) {
+        pos += histogram_print(&loops[i], buff + pos, len - pos);
+    }
+}
+
+#endif // MAIN_LOOP_PROFILER
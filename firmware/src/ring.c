@@ -0,0 +1,63 @@
+/*
+ * ring.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "config.h"
+#include "ring.h"
+
+bool rb_push(struct ring_buffer *rb, const void *data) {
+    size_t head = rb->head;
+    size_t next = (head + 1) % rb->size;
+    if (next == rb->tail) {
+        return false;
+    }
+
+    memcpy(rb->buffer + (head * rb->element_size), data, rb->element_size);
+
+    // element has to be visible before the new head
+    __dmb();
+    rb->head = next;
+    return true;
+}
+
+bool rb_pop(struct ring_buffer *rb, void *data) {
+    size_t tail = rb->tail;
+    if (tail == rb->head) {
+        return false;
+    }
+
+    __dmb();
+    memcpy(data, rb->buffer + (tail * rb->element_size), rb->element_size);
+
+    // element has to be copied before the slot is released
+    __dmb();
+    rb->tail = (tail + 1) % rb->size;
+    return true;
+}
+
+size_t rb_len(const struct ring_buffer *rb) {
+    size_t head = rb->head, tail = rb->tail;
+    return (head + rb->size - tail) % rb->size;
+}
+
+bool rb_full(const struct ring_buffer *rb) {
+    return ((rb->head + 1) % rb->size) == rb->tail;
+}
@@ -0,0 +1,149 @@
+/*
+ * sched.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+
+#include "config.h"
+#include "histogram.h"
+#include "prof.h"
+#include "sched.h"
+
+struct sched_stats {
+    uint64_t start;
+    uint64_t sleep_us;
+    uint32_t sleeps;
+    uint32_t early_wakes;
+};
+
+static struct sched_stats stats[2];
+
+// how late a core woke up after its next deadline
+static struct histogram wake_latency[2] = {
+    HISTOGRAM_INIT("core0 wake", 2),
+    HISTOGRAM_INIT("core1 wake", 2),
+};
+
+static uint64_t sched_pass(struct sched_task *tasks, size_t count) {
+    uint64_t deadline = UINT64_MAX;
+
+    for (size_t i = 0; i < count; i++) {
+        struct sched_task *t = &tasks[i];
+        uint64_t now = time_us_64();
+        bool due = (t->next != 0) && (now >= t->next);
+
+        if (due || t->every_pass) {
+            PROF_RUN(t->prof, t->run());
+        }
+
+        if (due && (t->period_us != 0)) {
+            // keep the phase, but never try to catch up missed periods
+            t->next += t->period_us;
+            if (t->next <= now) {
+                t->next = now + t->period_us;
+            }
+        } else if (due && (t->next <= now)) {
+            // one-shot deadline, unless the task has requested a new one
+            t->next = 0;
+        }
+
+        if ((t->next != 0) && (t->next < deadline)) {
+            deadline = t->next;
+        }
+    }
+
+    return deadline;
+}
+
+static void sched_sleep(struct sched_stats *s, struct histogram *h, uint64_t deadline) {
+    uint64_t before = time_us_64();
+    if (deadline <= before) {
+        return;
+    }
+
+    // returns early on interrupts and events from the other core
+    best_effort_wfe_or_timeout(from_us_since_boot(deadline));
+
+    uint64_t after = time_us_64();
+    s->sleep_us += after - before;
+    s->sleeps++;
+
+    if (after >= deadline) {
+        uint64_t late = after - deadline;
+        histogram_add(h, (late > UINT32_MAX) ? UINT32_MAX : late);
+    } else {
+        s->early_wakes++;
+    }
+}
+
+void sched_loop(struct sched_task *tasks, size_t count) {
+    uint core = get_core_num();
+    stats[core].start = time_us_64();
+
+    for (size_t i = 0; i < count; i++) {
+        if (tasks[i].period_us != 0) {
+            tasks[i].next = stats[core].start;
+        }
+    }
+
+    while (1) {
+        PROF_LOOP();
+        uint64_t deadline = sched_pass(tasks, count);
+        sched_sleep(&stats[core], &wake_latency[core], deadline);
+    }
+}
+
+void sched_wake(void) {
+    __sev();
+}
+
+void sched_wake_at(struct sched_task *task, uint64_t time_us) {
+    task->next = time_us;
+}
+
+void sched_reset(void) {
+    uint64_t now = time_us_64();
+    for (int i = 0; i < 2; i++) {
+        histogram_reset(&wake_latency[i]);
+        stats[i].start = now;
+        stats[i].sleep_us = 0;
+        stats[i].sleeps = 0;
+        stats[i].early_wakes = 0;
+    }
+}
+
+size_t sched_print(char *buff, size_t len) {
+    uint64_t now = time_us_64();
+    size_t pos = 0;
+
+    pos += snprintf(buff + pos, len - pos, "Scheduler:\r\n");
+    for (int i = 0; i < 2; i++) {
+        uint64_t elapsed = now - stats[i].start;
+        uint32_t idle = (elapsed > 0) ? (stats[i].sleep_us * 100 / elapsed) : 0;
+        pos += snprintf(buff + pos, len - pos,
+                        "  core%d: idle=%lu%% sleeps=%lu early=%lu\r\n",
+                        i, idle, stats[i].sleeps, stats[i].early_wakes);
+    }
+
+    pos += snprintf(buff + pos, len - pos, "Wake-up latency after deadline:\r\n");
+    for (int i = 0; i < 2; i++) {
+        pos += histogram_print(&wake_latency[i], buff + pos, len - pos);
+    }
+
+    return pos;
+}
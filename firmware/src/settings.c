@@ -0,0 +1,130 @@
+/*
+ * settings.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "pico/multicore.h"
+
+#include "config.h"
+#include "log.h"
+#include "pmw3360_power.h"
+#include "usb_hid.h"
+#include "settings.h"
+
+#define SETTINGS_MAGIC 0x4C4C4254 // "TBLL"
+#define SETTINGS_VERSION 6
+
+#define SETTINGS_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+#define SETTINGS_FLASH_SIZE ((sizeof(struct settings_flash) + FLASH_PAGE_SIZE - 1) \
+                             / FLASH_PAGE_SIZE * FLASH_PAGE_SIZE)
+
+struct settings_flash {
+    uint32_t magic;
+    uint32_t version;
+    struct settings data;
+    uint32_t checksum;
+};
+
+static_assert(SETTINGS_FLASH_SIZE <= FLASH_SECTOR_SIZE, "settings do not fit into flash sector");
+
+static const struct settings settings_default = {
+    .pmw_profile = DEFAULT_PMW_PROFILE,
+    .mouse_report = DEFAULT_MOUSE_REPORT,
+    .hid_interval_ms = DEFAULT_HID_INTERVAL_MS,
+    .button_debounce_eager = DEFAULT_BUTTON_DEBOUNCE_EAGER,
+    .keymap = CONTROLS_DEFAULT_KEYMAP,
+};
+
+static struct settings settings;
+
+static const struct settings_flash *settings_flash(void) {
+    return (const struct settings_flash *)(XIP_BASE + SETTINGS_FLASH_OFFSET);
+}
+
+static uint32_t settings_checksum(const struct settings *s) {
+    const uint8_t *p = (const uint8_t *)s;
+    uint32_t sum = SETTINGS_MAGIC;
+    for (size_t i = 0; i < sizeof(struct settings); i++) {
+        sum = (sum << 5) + sum + p[i];
+    }
+    return sum;
+}
+
+static bool settings_flash_valid(void) {
+    const struct settings_flash *f = settings_flash();
+    return (f->magic == SETTINGS_MAGIC)
+        && (f->version == SETTINGS_VERSION)
+        && (f->checksum == settings_checksum(&f->data));
+}
+
+void settings_init(void) {
+    if (settings_flash_valid()) {
+        memcpy(&settings, &settings_flash()->data, sizeof(settings));
+        debug("loaded settings from flash");
+    } else {
+        memcpy(&settings, &settings_default, sizeof(settings));
+        debug("no valid settings in flash, using defaults");
+    }
+}
+
+struct settings *settings_get(void) {
+    return &settings;
+}
+
+int settings_save(void) {
+    if (settings_flash_valid()
+            && (memcmp(&settings_flash()->data, &settings, sizeof(settings)) == 0)) {
+        return 0;
+    }
+
+    static uint8_t page[SETTINGS_FLASH_SIZE];
+    memset(page, 0xFF, sizeof(page));
+
+    struct settings_flash *f = (struct settings_flash *)page;
+    f->magic = SETTINGS_MAGIC;
+    f->version = SETTINGS_VERSION;
+    memcpy(&f->data, &settings, sizeof(settings));
+
+    // statistics in the live copy may change meanwhile on the other core
+    f->checksum = settings_checksum(&f->data);
+
+    // code runs from flash, so nothing may interrupt us while erasing,
+    // and the other core has to wait in RAM
+    bool lockout = multicore_lockout_victim_is_initialized(1 - get_core_num());
+    if (lockout) {
+        multicore_lockout_start_blocking();
+    }
+    uint32_t irq = save_and_disable_interrupts();
+    flash_range_erase(SETTINGS_FLASH_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(SETTINGS_FLASH_OFFSET, page, SETTINGS_FLASH_SIZE);
+    restore_interrupts(irq);
+    if (lockout) {
+        multicore_lockout_end_blocking();
+    }
+
+    if (!settings_flash_valid()) {
+        debug("error verifying settings in flash");
+        return -1;
+    }
+
+    debug("stored settings in flash");
+    return 0;
+}
@@ -35,22 +35,46 @@
 #include "usb_descriptors.h"
 #include "usb_cdc.h"
 #include "usb_hid.h"
+#include "boot.h"
+#include "buttons.h"
 #include "usb.h"
 
+#define USB_RECONNECT_DELAY_MS 250
+
+static uint32_t reconnect_time = 0;
+static bool reconnect_pending = false;
+
 void usb_init(void) {
     usb_descriptor_init_id();
+    usb_hid_init();
 
     board_init();
     tusb_init();
+
+    // mouse reports are sent from start-of-frame
+    tud_sof_cb_enable(true);
 }
 
 void usb_run(void) {
     tud_task();
     hid_task();
+
+    if (reconnect_pending && ((board_millis() - reconnect_time) >= USB_RECONNECT_DELAY_MS)) {
+        reconnect_pending = false;
+        tud_connect();
+    }
+}
+
+void usb_reconnect(void) {
+    // host needs to notice the disconnect before we come back
+    tud_disconnect();
+    reconnect_time = board_millis();
+    reconnect_pending = true;
 }
 
 // Invoked when device is mounted
 void tud_mount_cb(void) {
+    boot_mark(BOOT_EV_USB_MOUNTED);
     debug("device mounted");
 }
 
@@ -64,9 +88,11 @@ void tud_umount_cb(void) {
 // Within 7ms, device must draw an average of current less than 2.5 mA from bus
 void tud_suspend_cb(bool remote_wakeup_en) {
     debug("device suspended wakeup=%d", remote_wakeup_en);
+    buttons_wear_set_suspended(true);
 }
 
 // Invoked when usb bus is resumed
 void tud_resume_cb(void) {
     debug("device resumed");
+    buttons_wear_set_suspended(false);
 }
@@ -34,11 +34,17 @@
 #include "console.h"
 #include "log.h"
 #include "util.h"
+#include "work.h"
 #include "usb_descriptors.h"
 #include "usb_cdc.h"
 
 static bool reroute_cdc_debug = false;
 
+static void cdc_rx_work(struct work *work);
+static void cdc_connect_work(struct work *work);
+static struct work rx_work = WORK_INIT(cdc_rx_work);
+static struct work connect_work = WORK_INIT(cdc_connect_work);
+
 void usb_cdc_write(const char *buf, uint32_t count) {
 #ifndef DISABLE_CDC_DTR_CHECK
     if (!tud_cdc_connected()) {
@@ -96,13 +102,8 @@ void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts) {
     static bool last_dtr = false;
 
     if (dtr && !last_dtr) {
-        // clear left-over console input
-        cnsl_init();
-
-        // show past history
-        log_dump_to_usb();
-
-        debug("terminal connected");
+        // writing calls tud_task, so not from within its callback
+        work_post(&connect_work);
     } else if (!dtr && last_dtr) {
         debug("terminal disconnected");
     }
@@ -110,8 +111,30 @@ void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts) {
     last_dtr = dtr;
 }
 
+static void cdc_connect_work(struct work *work) {
+    (void) work;
+
+    // clear left-over console input
+    cnsl_init();
+
+    // show past history
+    log_dump_to_usb();
+
+    debug("terminal connected");
+}
+
+static void cdc_rx_work(struct work *work) {
+    (void) work;
+
+    while (tud_cdc_available()) {
+        cdc_task();
+    }
+}
+
 // invoked when CDC interface received data from host
 void tud_cdc_rx_cb(uint8_t itf) {
     (void) itf;
-    cdc_task();
+
+    // console commands are executed from the main loop
+    work_post(&rx_work);
 }
@@ -32,6 +32,7 @@
 
 #include "config.h"
 #include "usb_descriptors.h"
+#include "usb_hid.h"
 
 /*
  * A combination of interfaces must have a unique product id,
@@ -91,6 +92,55 @@ uint8_t const * tud_descriptor_device_cb(void) {
 // HID Report Descriptor
 //--------------------------------------------------------------------+
 
+// Same layout as TUD_HID_REPORT_DESC_MOUSE, but with 16bit X / Y
+#define TUD_HID_REPORT_DESC_MOUSE16(...) \
+  HID_USAGE_PAGE ( HID_USAGE_PAGE_DESKTOP      )                   ,\
+  HID_USAGE      ( HID_USAGE_DESKTOP_MOUSE     )                   ,\
+  HID_COLLECTION ( HID_COLLECTION_APPLICATION  )                   ,\
+    /* Report ID if any */\
+    __VA_ARGS__ \
+    HID_USAGE      ( HID_USAGE_DESKTOP_POINTER )                   ,\
+    HID_COLLECTION ( HID_COLLECTION_PHYSICAL   )                   ,\
+      HID_USAGE_PAGE  ( HID_USAGE_PAGE_BUTTON  )                   ,\
+        HID_USAGE_MIN   ( 1                                      ) ,\
+        HID_USAGE_MAX   ( 5                                      ) ,\
+        HID_LOGICAL_MIN ( 0                                      ) ,\
+        HID_LOGICAL_MAX ( 1                                      ) ,\
+        /* Left, Right, Middle, Backward, Forward buttons */ \
+        HID_REPORT_COUNT( 5                                      ) ,\
+        HID_REPORT_SIZE ( 1                                      ) ,\
+        HID_INPUT       ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ) ,\
+        /* 3 bit padding */ \
+        HID_REPORT_COUNT( 1                                      ) ,\
+        HID_REPORT_SIZE ( 3                                      ) ,\
+        HID_INPUT       ( HID_CONSTANT                           ) ,\
+      HID_USAGE_PAGE  ( HID_USAGE_PAGE_DESKTOP )                   ,\
+        /* X, Y position [-32767, 32767] */ \
+        HID_USAGE       ( HID_USAGE_DESKTOP_X                    ) ,\
+        HID_USAGE       ( HID_USAGE_DESKTOP_Y                    ) ,\
+        HID_LOGICAL_MIN_N ( -32767, 2                            ) ,\
+        HID_LOGICAL_MAX_N ( 32767, 2                             ) ,\
+        HID_REPORT_COUNT( 2                                      ) ,\
+        HID_REPORT_SIZE ( 16                                     ) ,\
+        HID_INPUT       ( HID_DATA | HID_VARIABLE | HID_RELATIVE ) ,\
+        /* Vertical wheel scroll [-127, 127] */ \
+        HID_USAGE       ( HID_USAGE_DESKTOP_WHEEL                ) ,\
+        HID_LOGICAL_MIN ( 0x81                                   ) ,\
+        HID_LOGICAL_MAX ( 0x7f                                   ) ,\
+        HID_REPORT_COUNT( 1                                      ) ,\
+        HID_REPORT_SIZE ( 8                                      ) ,\
+        HID_INPUT       ( HID_DATA | HID_VARIABLE | HID_RELATIVE ) ,\
+      HID_USAGE_PAGE  ( HID_USAGE_PAGE_CONSUMER ), \
+       /* Horizontal wheel scroll [-127, 127] */ \
+        HID_USAGE_N     ( HID_USAGE_CONSUMER_AC_PAN, 2           ) ,\
+        HID_LOGICAL_MIN ( 0x81                                   ) ,\
+        HID_LOGICAL_MAX ( 0x7f                                   ) ,\
+        HID_REPORT_COUNT( 1                                      ) ,\
+        HID_REPORT_SIZE ( 8                                      ) ,\
+        HID_INPUT       ( HID_DATA | HID_VARIABLE | HID_RELATIVE ) ,\
+    HID_COLLECTION_END                                            ,\
+  HID_COLLECTION_END
+
 uint8_t const desc_hid_report[] = {
     TUD_HID_REPORT_DESC_KEYBOARD( HID_REPORT_ID(REPORT_ID_KEYBOARD         )),
     TUD_HID_REPORT_DESC_MOUSE   ( HID_REPORT_ID(REPORT_ID_MOUSE            )),
@@ -98,11 +148,22 @@ uint8_t const desc_hid_report[] = {
     TUD_HID_REPORT_DESC_GAMEPAD ( HID_REPORT_ID(REPORT_ID_GAMEPAD          ))
 };
 
+uint8_t const desc_hid_report16[] = {
+    TUD_HID_REPORT_DESC_KEYBOARD( HID_REPORT_ID(REPORT_ID_KEYBOARD         )),
+    TUD_HID_REPORT_DESC_MOUSE16 ( HID_REPORT_ID(REPORT_ID_MOUSE            )),
+    TUD_HID_REPORT_DESC_CONSUMER( HID_REPORT_ID(REPORT_ID_CONSUMER_CONTROL )),
+    TUD_HID_REPORT_DESC_GAMEPAD ( HID_REPORT_ID(REPORT_ID_GAMEPAD          ))
+};
+
 // Invoked when received GET HID REPORT DESCRIPTOR
 // Application return pointer to descriptor
 // Descriptor contents must exist long enough for transfer to complete
 uint8_t const * tud_hid_descriptor_report_cb(uint8_t instance) {
     (void) instance;
+
+    if (usb_hid_get_mouse_report() == HID_MOUSE_REPORT_16BIT) {
+        return desc_hid_report16;
+    }
     return desc_hid_report;
 }
 
@@ -127,19 +188,41 @@ enum {
 #define EPNUM_MSC_OUT   0x03
 #define EPNUM_MSC_IN    0x84
 
-uint8_t const desc_configuration[] = {
-    // Config number, interface count, string index, total length, attribute, power in mA
-    TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 100),
+// only the HID report descriptor length differs between both variants
+#define DESC_CONFIGURATION(hid_report_len) { \
+    /* Config number, interface count, string index, total length, attribute, power in mA */ \
+    TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 100), \
+    \
+    /* Interface number, string index, EP notification address and size, EP data address (out, in) and size. */ \
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, 4, EPNUM_CDC_NOTIF, 8, EPNUM_CDC_OUT, EPNUM_CDC_IN, 64), \
+    \
+    /* Interface number, string index, protocol, report descriptor len, EP In address, size & polling interval */ \
+    TUD_HID_DESCRIPTOR(ITF_NUM_HID, 5, HID_ITF_PROTOCOL_NONE, hid_report_len, EPNUM_HID, CFG_TUD_HID_EP_BUFSIZE, 1), \
+    \
+    /* Interface number, string index, EP Out & EP In address, EP size */ \
+    TUD_MSC_DESCRIPTOR(ITF_NUM_MSC, 6, EPNUM_MSC_OUT, EPNUM_MSC_IN, 64), \
+}
 
-    // Interface number, string index, EP notification address and size, EP data address (out, in) and size.
-    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, 4, EPNUM_CDC_NOTIF, 8, EPNUM_CDC_OUT, EPNUM_CDC_IN, 64),
+uint8_t const desc_configuration[] = DESC_CONFIGURATION(sizeof(desc_hid_report));
+uint8_t const desc_configuration16[] = DESC_CONFIGURATION(sizeof(desc_hid_report16));
 
-    // Interface number, string index, protocol, report descriptor len, EP In address, size & polling interval
-    TUD_HID_DESCRIPTOR(ITF_NUM_HID, 5, HID_ITF_PROTOCOL_NONE, sizeof(desc_hid_report), EPNUM_HID, CFG_TUD_HID_EP_BUFSIZE, 5),
+// bInterval is the last byte of the HID endpoint descriptor
+#define HID_EP_INTERVAL_OFFSET (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_HID_DESC_LEN - 1)
 
-    // Interface number, string index, EP Out & EP In address, EP size
-    TUD_MSC_DESCRIPTOR(ITF_NUM_MSC, 6, EPNUM_MSC_OUT, EPNUM_MSC_IN, 64),
-};
+static uint8_t desc_configuration_buff[CONFIG_TOTAL_LEN];
+
+static uint8_t const *usb_desc_configuration(void) {
+    if (usb_hid_get_mouse_report() == HID_MOUSE_REPORT_16BIT) {
+        memcpy(desc_configuration_buff, desc_configuration16, CONFIG_TOTAL_LEN);
+    } else {
+        memcpy(desc_configuration_buff, desc_configuration, CONFIG_TOTAL_LEN);
+    }
+
+    // polling interval selected at runtime, in frames (ms) for full speed
+    desc_configuration_buff[HID_EP_INTERVAL_OFFSET] = usb_hid_get_interval();
+
+    return desc_configuration_buff;
+}
 
 #if TUD_OPT_HIGH_SPEED
 // Per USB specs: high speed capable device must report device_qualifier and other_speed_configuration
@@ -177,7 +260,7 @@ uint8_t const* tud_descriptor_other_speed_configuration_cb(uint8_t index) {
     (void) index; // for multiple configurations
 
     // other speed config is basically configuration with type = OHER_SPEED_CONFIG
-    memcpy(desc_other_speed_config, desc_configuration, CONFIG_TOTAL_LEN);
+    memcpy(desc_other_speed_config, usb_desc_configuration(), CONFIG_TOTAL_LEN);
     desc_other_speed_config[1] = TUSB_DESC_OTHER_SPEED_CONFIG;
 
     // this example use the same configuration for both high and full speed mode
@@ -193,7 +276,7 @@ uint8_t const * tud_descriptor_configuration_cb(uint8_t index) {
     (void) index; // for multiple configurations
 
     // This example use the same configuration for both high and full speed mode
-    return desc_configuration;
+    return usb_desc_configuration();
 }
 
 //--------------------------------------------------------------------+
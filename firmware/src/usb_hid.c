@@ -27,14 +27,107 @@
  *
  */
 
+#include <stdio.h>
+#include <string.h>
+
 #include "bsp/board.h"
 #include "tusb.h"
 
 #include "config.h"
+#include "log.h"
 #include "controls.h"
+#include "core1.h"
+#include "latency.h"
+#include "settings.h"
+#include "usb.h"
 #include "usb_descriptors.h"
 #include "usb_hid.h"
 
+typedef struct TU_ATTR_PACKED {
+    uint8_t buttons;
+    int16_t x;
+    int16_t y;
+    int8_t wheel;
+    int8_t pan;
+} hid_mouse16_report_t;
+
+#define HID_SOF_TIMEOUT_MS 10
+
+static enum hid_mouse_report mouse_report = DEFAULT_MOUSE_REPORT;
+static uint8_t hid_interval_ms = DEFAULT_HID_INTERVAL_MS;
+static uint32_t last_sof_ms = 0;
+static uint64_t reports_sent = 0;
+static uint64_t reports_suppressed = 0;
+static uint64_t report_sample_time = 0; // oldest sample in report in flight
+static bool keyboard_pending = false;
+static uint8_t keyboard_modifier = 0;
+static uint8_t keyboard_keycode[6] = { 0 };
+
+static void usb_hid_apply_mouse_report(enum hid_mouse_report report) {
+    if (report >= HID_MOUSE_REPORT_COUNT) {
+        report = DEFAULT_MOUSE_REPORT;
+    }
+
+    mouse_report = report;
+    controls_set_delta_max((report == HID_MOUSE_REPORT_16BIT) ? MOUSE_DELTA_MAX_16BIT : MOUSE_DELTA_MAX_8BIT);
+}
+
+static bool usb_hid_interval_valid(uint8_t interval_ms) {
+    return (interval_ms == 1) || (interval_ms == 2) || (interval_ms == 4) || (interval_ms == 8);
+}
+
+void usb_hid_init(void) {
+    usb_hid_apply_mouse_report(settings_get()->mouse_report);
+
+    hid_interval_ms = settings_get()->hid_interval_ms;
+    if (!usb_hid_interval_valid(hid_interval_ms)) {
+        hid_interval_ms = DEFAULT_HID_INTERVAL_MS;
+    }
+}
+
+uint8_t usb_hid_get_interval(void) {
+    return hid_interval_ms;
+}
+
+void usb_hid_print_status(char *buff, size_t len) {
+    size_t pos = 0;
+    pos += snprintf(buff + pos, len - pos, "HID statistics:\r\n");
+    pos += snprintf(buff + pos, len - pos, "      report = %s\r\n",
+            (mouse_report == HID_MOUSE_REPORT_16BIT) ? "16bit" : "8bit");
+    pos += snprintf(buff + pos, len - pos, "        rate = %dHz\r\n", 1000 / hid_interval_ms);
+    pos += snprintf(buff + pos, len - pos, "        sent = %llu\r\n", reports_sent);
+    pos += snprintf(buff + pos, len - pos, "  suppressed = %llu\r\n", reports_suppressed);
+}
+
+int usb_hid_set_interval(uint8_t interval_ms) {
+    if (!usb_hid_interval_valid(interval_ms)) {
+        return -1;
+    }
+
+    hid_interval_ms = interval_ms;
+
+    settings_get()->hid_interval_ms = hid_interval_ms;
+    settings_save();
+
+    debug("re-enumerating with %dHz polling rate", 1000 / hid_interval_ms);
+    usb_reconnect();
+    return 0;
+}
+
+enum hid_mouse_report usb_hid_get_mouse_report(void) {
+    return mouse_report;
+}
+
+void usb_hid_set_mouse_report(enum hid_mouse_report report) {
+    usb_hid_apply_mouse_report(report);
+
+    settings_get()->mouse_report = mouse_report;
+    settings_save();
+
+    debug("re-enumerating with %s mouse report", (mouse_report == HID_MOUSE_REPORT_16BIT) ? "16bit" : "8bit");
+    usb_reconnect();
+}
+
 static void send_hid_report(uint8_t report_id, uint32_t btn) {
     // skip if hid is not ready yet
     if ( !tud_hid_ready() ) return;
@@ -42,26 +135,21 @@ static void send_hid_report(uint8_t report_id, uint32_t btn) {
     switch(report_id) {
         case REPORT_ID_KEYBOARD:
         {
-            // use to avoid send multiple consecutive zero report for keyboard
-            static bool has_keyboard_key = false;
-
-            if ( btn ) {
-                uint8_t keycode[6] = { 0 };
-                keycode[0] = HID_KEY_A;
-
-                tud_hid_keyboard_report(REPORT_ID_KEYBOARD, 0, keycode);
-                has_keyboard_key = true;
-            } else {
-                // send empty key report if previously has key pressed
-                if (has_keyboard_key) tud_hid_keyboard_report(REPORT_ID_KEYBOARD, 0, NULL);
-                has_keyboard_key = false;
+            // key chords of remapped buttons, follow the mouse report
+            if (keyboard_pending) {
+                tud_hid_keyboard_report(REPORT_ID_KEYBOARD, keyboard_modifier, keyboard_keycode);
+                keyboard_pending = false;
             }
         }
         break;
 
         case REPORT_ID_MOUSE:
         {
-            struct mouse_state mouse = controls_mouse_read();
+            // built on core 1 after core1_request_report()
+            struct mouse_state mouse;
+            if (!core1_get_report(&mouse)) {
+                break;
+            }
 
             uint8_t buttons = 0x00;
             if (mouse.button[MOUSE_LEFT]) {
@@ -76,13 +164,43 @@ static void send_hid_report(uint8_t report_id, uint32_t btn) {
             if (mouse.button[MOUSE_BACK]) {
                 buttons |= MOUSE_BUTTON_BACKWARD;
             }
+            if (mouse.button[MOUSE_FORWARD]) {
+                buttons |= MOUSE_BUTTON_FORWARD;
+            }
+
+            if (mouse.keys_changed) {
+                keyboard_modifier = mouse.key_modifier;
+                memcpy(keyboard_keycode, mouse.keycode, sizeof(keyboard_keycode));
+                keyboard_pending = true;
+            }
+
+            if (!mouse.changed) {
+                // nothing new for the host, keep the endpoint idle
+                reports_suppressed++;
+            } else {
+                reports_sent++;
+
+                if (mouse_report == HID_MOUSE_REPORT_16BIT) {
+                    hid_mouse16_report_t report = {
+                        .buttons = buttons,
+                        .x = mouse.delta_x * (INVERT_MOUSE_X_AXIS ? -1 : 1),
+                        .y = mouse.delta_y * (INVERT_MOUSE_Y_AXIS ? -1 : 1),
+                        .wheel = mouse.scroll_y * (INVERT_SCROLL_Y_AXIS ? -1 : 1),
+                        .pan = mouse.scroll_x * (INVERT_SCROLL_X_AXIS ? -1 : 1),
+                    };
+                    tud_hid_report(REPORT_ID_MOUSE, &report, sizeof(report));
+                } else {
+                    tud_hid_mouse_report(REPORT_ID_MOUSE, buttons,
+                            mouse.delta_x * (INVERT_MOUSE_X_AXIS ? -1 : 1),
+                            mouse.delta_y * (INVERT_MOUSE_Y_AXIS ? -1 : 1),
+                            mouse.scroll_y * (INVERT_SCROLL_Y_AXIS ? -1 : 1),
+                            mouse.scroll_x * (INVERT_SCROLL_X_AXIS ? -1 : 1));
+                }
 
-            if (mouse.changed) {
-                tud_hid_mouse_report(REPORT_ID_MOUSE, buttons,
-                        mouse.delta_x * (INVERT_MOUSE_X_AXIS ? -1 : 1),
-                        mouse.delta_y * (INVERT_MOUSE_Y_AXIS ? -1 : 1),
-                        mouse.scroll_y * (INVERT_SCROLL_Y_AXIS ? -1 : 1),
-                        mouse.scroll_x * (INVERT_SCROLL_X_AXIS ? -1 : 1));
+                if (mouse.samples > 0) {
+                    latency_add(LAT_REPORT_QUEUED, mouse.sample_time_oldest);
+                    report_sample_time = mouse.sample_time_oldest;
+                }
             }
         }
         break;
@@ -135,16 +253,7 @@ static void send_hid_report(uint8_t report_id, uint32_t btn) {
     }
 }
 
-// Every 10ms, we will sent 1 report for each HID profile (keyboard, mouse etc ..)
-// tud_hid_report_complete_cb() is used to send the next report after previous one is complete
-void hid_task(void) {
-    // Poll every 10ms
-    const uint32_t interval_ms = 10;
-    static uint32_t start_ms = 0;
-
-    if ( board_millis() - start_ms < interval_ms) return; // not enough time
-    start_ms += interval_ms;
-
+static void hid_report_start(void) {
     uint32_t const btn = 0;
 
     // Remote wakeup
@@ -153,12 +262,44 @@ void hid_task(void) {
         // and REMOTE_WAKEUP feature is enabled by host
         tud_remote_wakeup();
     } else {
-        // Send the 1st of report chain, the rest will be sent by tud_hid_report_complete_cb()
+        // The mouse report is built on core 1 and sent from hid_task() as soon as it arrives,
+        // starting the report chain, the rest will be sent by tud_hid_report_complete_cb()
         //send_hid_report(REPORT_ID_KEYBOARD, btn);
-        send_hid_report(REPORT_ID_MOUSE, btn);
+        if (tud_hid_ready()) {
+            core1_request_report();
+        }
     }
 }
 
+// Every interval frames we send 1 report for each HID profile (keyboard, mouse etc ..),
+// right after start-of-frame so the report is ready when the host polls.
+// tud_hid_report_complete_cb() is used to send the next report after previous one is complete
+void tud_sof_cb(uint32_t frame_count) {
+    last_sof_ms = board_millis();
+
+    // frame counter wraps at 2048, a multiple of all intervals
+    if ((frame_count % hid_interval_ms) == 0) {
+        hid_report_start();
+    }
+}
+
+// fallback while there are no start-of-frame events, eg. when suspended
+void hid_task(void) {
+    static uint32_t start_ms = 0;
+
+    // send mouse report once core 1 has built it,
+    // then the keyboard report when keys changed with it
+    send_hid_report(REPORT_ID_MOUSE, 0);
+    send_hid_report(REPORT_ID_KEYBOARD, 0);
+
+    if ((board_millis() - last_sof_ms) < HID_SOF_TIMEOUT_MS) return; // SOF is active
+
+    if ( board_millis() - start_ms < hid_interval_ms) return; // not enough time
+    start_ms += hid_interval_ms;
+
+    hid_report_start();
+}
+
 // Invoked when sent REPORT successfully to host
 // Application can use this to send the next report
 // Note: For composite reports, report[0] is report ID
@@ -166,6 +307,11 @@ void tud_hid_report_complete_cb(uint8_t instance, uint8_t const* report, uint8_t
     (void) instance;
     (void) len;
 
+    if ((report[0] == REPORT_ID_MOUSE) && (report_sample_time != 0)) {
+        latency_add(LAT_REPORT_COMPLETE, report_sample_time);
+        report_sample_time = 0;
+    }
+
     uint8_t next_report_id = report[0] + 1;
 
     if (next_report_id < REPORT_ID_COUNT) {
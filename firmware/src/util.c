@@ -25,12 +25,6 @@
 #include "log.h"
 #include "util.h"
 
-#define HEARTBEAT_INTERVAL_MS 500
-
-#ifdef PICO_DEFAULT_LED_PIN
-static uint32_t last_heartbeat = 0;
-#endif // PICO_DEFAULT_LED_PIN
-
 void heartbeat_init(void) {
 #ifdef PICO_DEFAULT_LED_PIN
     gpio_init(PICO_DEFAULT_LED_PIN);
@@ -41,11 +35,7 @@ void heartbeat_init(void) {
 
 void heartbeat_run(void) {
 #ifdef PICO_DEFAULT_LED_PIN
-    uint32_t now = to_ms_since_boot(get_absolute_time());
-    if (now >= (last_heartbeat + HEARTBEAT_INTERVAL_MS)) {
-        last_heartbeat = now;
-        gpio_xor_mask(1 << PICO_DEFAULT_LED_PIN);
-    }
+    gpio_xor_mask(1 << PICO_DEFAULT_LED_PIN);
 #endif // PICO_DEFAULT_LED_PIN
 }
 
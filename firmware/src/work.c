@@ -0,0 +1,79 @@
+/*
+ * work.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include "pico/stdlib.h"
+#include "pico/critical_section.h"
+
+#include "config.h"
+#include "log.h"
+#include "sched.h"
+#include "work.h"
+
+#define WORK_QUEUE_SIZE 16
+
+static struct work *queue[WORK_QUEUE_SIZE];
+static size_t head = 0, tail = 0;
+static critical_section_t work_lock;
+
+void work_init(void) {
+    critical_section_init(&work_lock);
+}
+
+bool work_post(struct work *work) {
+    bool r = true;
+
+    critical_section_enter_blocking(&work_lock);
+    if (!work->queued) {
+        size_t next = (head + 1) % WORK_QUEUE_SIZE;
+        if (next == tail) {
+            r = false;
+        } else {
+            work->queued = true;
+            queue[head] = work;
+            head = next;
+        }
+    }
+    critical_section_exit(&work_lock);
+
+    // main loop may be sleeping on the other core
+    sched_wake();
+
+    return r;
+}
+
+void work_run(void) {
+    while (1) {
+        struct work *work = NULL;
+
+        critical_section_enter_blocking(&work_lock);
+        if (tail != head) {
+            work = queue[tail];
+            tail = (tail + 1) % WORK_QUEUE_SIZE;
+
+            // may be posted again while running
+            work->queued = false;
+        }
+        critical_section_exit(&work_lock);
+
+        if (work == NULL) {
+            break;
+        }
+
+        work->fn(work);
+    }
+}
@@ -0,0 +1,49 @@
+/*
+ * spi.h
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MOCK_HARDWARE_SPI_H__
+#define __MOCK_HARDWARE_SPI_H__
+
+#include "pico/stdlib.h"
+
+/*
+ * Writes to dr are detected by mock_sdk.c, which keeps values
+ * above 0xFF in it. Reading received bytes goes through
+ * spi_is_readable(), which loads the next one into dr.
+ */
+typedef struct {
+    volatile uint32_t dr;
+    volatile uint32_t icr;
+} spi_hw_t;
+
+typedef struct spi_inst spi_inst_t;
+
+#define spi_default ((spi_inst_t *)0)
+#define SPI_MSB_FIRST 1
+#define SPI_SSPICR_RORIC_BITS 0x1
+
+spi_hw_t *spi_get_hw(spi_inst_t *spi);
+uint spi_init(spi_inst_t *spi, uint baudrate);
+void spi_set_format(spi_inst_t *spi, uint bits, uint cpol, uint cpha, uint order);
+bool spi_is_busy(spi_inst_t *spi);
+bool spi_is_readable(spi_inst_t *spi);
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len);
+int spi_read_blocking(spi_inst_t *spi, uint8_t tx, uint8_t *dst, size_t len);
+uint spi_get_dreq(spi_inst_t *spi, bool is_tx);
+
+#endif // __MOCK_HARDWARE_SPI_H__
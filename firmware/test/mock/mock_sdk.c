@@ -0,0 +1,527 @@
+/*
+ * mock_sdk.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/spi.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/timer.h"
+
+#include "pmw3360_registers.h"
+#include "mock_sdk.h"
+
+#define LOG_SIZE 8192
+#define RX_FIFO_SIZE 8
+#define DMA_CHANNELS 12
+#define CLK_SYS_HZ 125000000
+
+#define DREQ_SPI0_TX 16
+#define DREQ_SPI0_RX 17
+#define DREQ_DMA_TIMER0 0x3B
+
+uint64_t mock_now = 0;
+
+uint8_t mock_regs[0x80] = { 0 };
+uint8_t mock_burst[MOCK_BURST_SIZE] = { 0 };
+bool mock_burst_mode = false;
+uint32_t mock_burst_errors = 0;
+
+static struct mock_event events[LOG_SIZE];
+static size_t event_count = 0;
+
+static bool in_irq = false;
+static bool ncs = true;
+static uint8_t address = 0;
+static uint32_t byte_index = 0;
+
+// dr always holds a value above 0xFF, unless firmware wrote to it
+static spi_hw_t spi_hw = { .dr = 0x100, .icr = 0 };
+static uint64_t tx_end = 0;
+static struct {
+    uint8_t value;
+    uint64_t ready;
+} rx_fifo[RX_FIFO_SIZE];
+static uint32_t rx_count = 0;
+
+static hardware_alarm_callback_t alarm_callback = NULL;
+static bool alarm_armed = false, alarm_forced = false;
+static uint64_t alarm_target = 0;
+static int alarms_claimed = 0;
+
+static struct {
+    uint dreq;
+    volatile void *write_addr;
+    const volatile void *read_addr;
+    uint32_t count;
+    bool irq0_enabled, irq0_status;
+} dma[DMA_CHANNELS];
+static int dma_claimed = 0;
+static uint16_t dma_timer_num = 1, dma_timer_den = 1;
+static bool dma_burst_active = false;
+static uint64_t dma_burst_end = 0;
+static int dma_burst_rx = -1;
+static uint64_t dma_load_end = 0;
+static irq_handler_t dma_irq_handler = NULL;
+static bool dma_irq_enabled = false;
+
+static void log_event(enum mock_event_type type, uint64_t start, uint64_t end, uint8_t mosi, uint8_t miso) {
+    if (event_count >= LOG_SIZE) {
+        return;
+    }
+    events[event_count++] = (struct mock_event){
+        .type = type,
+        .start = start,
+        .end = end,
+        .mosi = mosi,
+        .miso = miso,
+    };
+}
+
+void mock_log_clear(void) {
+    event_count = 0;
+}
+
+size_t mock_log(const struct mock_event **e) {
+    *e = events;
+    return event_count;
+}
+
+static uint8_t sensor_byte(uint8_t mosi) {
+    uint8_t miso = 0;
+
+    if (byte_index == 0) {
+        address = mosi;
+        if ((address & ~WRITE_BIT) != REG_MOTION_BURST) {
+            // any other register access leaves burst mode
+            mock_burst_mode = false;
+        } else if (address == REG_MOTION_BURST) {
+            if (!mock_burst_mode) {
+                mock_burst_errors++;
+            }
+        }
+    } else if (address & WRITE_BIT) {
+        if (byte_index == 1) {
+            mock_regs[address & ~WRITE_BIT] = mosi;
+            if (address == (REG_MOTION_BURST | WRITE_BIT)) {
+                mock_burst_mode = true;
+            }
+        }
+    } else if (address == REG_MOTION_BURST) {
+        if (byte_index <= MOCK_BURST_SIZE) {
+            miso = mock_burst[byte_index - 1];
+        }
+    } else {
+        miso = mock_regs[address];
+    }
+
+    byte_index++;
+    return miso;
+}
+
+// puts a byte into the TX FIFO at time t, returns the MISO byte
+static uint8_t spi_transfer(uint8_t mosi, uint64_t t, bool keep_rx) {
+    uint64_t start = MAX(t, tx_end);
+    tx_end = start + MOCK_T_BYTE;
+
+    uint8_t miso = 0xFF;
+    if (!ncs) {
+        miso = sensor_byte(mosi);
+    }
+    log_event(MOCK_BYTE, start, tx_end, mosi, miso);
+
+    if (keep_rx && (rx_count < RX_FIFO_SIZE)) {
+        rx_fifo[rx_count].value = miso;
+        rx_fifo[rx_count].ready = tx_end;
+        rx_count++;
+    }
+    return miso;
+}
+
+// picks up a byte the firmware has written to the data register
+static void mock_sync(void) {
+    if (spi_hw.dr < 0x100) {
+        spi_transfer(spi_hw.dr, mock_now, true);
+        spi_hw.dr = 0x100;
+    }
+}
+
+static void dma_burst_complete(void) {
+    dma_burst_active = false;
+
+    uint8_t *buff = (uint8_t *)dma[dma_burst_rx].write_addr;
+    uint64_t t = dma_burst_end - (dma[dma_burst_rx].count * MOCK_T_BYTE);
+    for (uint32_t i = 0; i < dma[dma_burst_rx].count; i++) {
+        buff[i] = spi_transfer(0, t + (i * MOCK_T_BYTE), false);
+    }
+
+    if (dma[dma_burst_rx].irq0_enabled) {
+        dma[dma_burst_rx].irq0_status = true;
+        if (dma_irq_enabled && dma_irq_handler) {
+            dma_irq_handler();
+        }
+    }
+}
+
+// runs one interrupt that is due, if any
+static bool mock_fire(void) {
+    if (in_irq) {
+        return false;
+    }
+
+    if (alarm_forced || (alarm_armed && (alarm_target <= mock_now))) {
+        alarm_forced = false;
+        alarm_armed = false;
+        in_irq = true;
+        alarm_callback(0);
+        in_irq = false;
+        mock_sync();
+        return true;
+    }
+
+    if (dma_burst_active && (dma_burst_end <= mock_now)) {
+        in_irq = true;
+        dma_burst_complete();
+        in_irq = false;
+        mock_sync();
+        return true;
+    }
+
+    return false;
+}
+
+void mock_run_us(uint64_t us) {
+    uint64_t target = mock_now + us;
+    while (mock_now < target) {
+        tight_loop_contents();
+    }
+    while (mock_fire());
+}
+
+void tight_loop_contents(void) {
+    mock_sync();
+    if (!mock_fire()) {
+        mock_now++;
+    }
+}
+
+void busy_wait_us(uint64_t us) {
+    mock_sync();
+    uint64_t target = mock_now + us;
+    while (mock_now < target) {
+        tight_loop_contents();
+    }
+}
+
+absolute_time_t get_absolute_time(void) {
+    mock_sync();
+    return mock_now;
+}
+
+absolute_time_t make_timeout_time_us(uint64_t us) {
+    mock_sync();
+    return mock_now + us;
+}
+
+absolute_time_t from_us_since_boot(uint64_t us) {
+    return us;
+}
+
+uint32_t to_ms_since_boot(absolute_time_t t) {
+    return t / 1000;
+}
+
+uint64_t time_us_64(void) {
+    mock_sync();
+    return mock_now;
+}
+
+uint32_t time_us_32(void) {
+    mock_sync();
+    return mock_now;
+}
+
+void gpio_init(uint gpio) {
+    (void)gpio;
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+    (void)gpio;
+    (void)out;
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn) {
+    (void)gpio;
+    (void)fn;
+}
+
+void gpio_put(uint gpio, bool value) {
+    mock_sync();
+    if ((gpio != PICO_DEFAULT_SPI_CSN_PIN) || (value == ncs)) {
+        return;
+    }
+
+    ncs = value;
+    if (!ncs) {
+        byte_index = 0;
+    }
+    log_event(ncs ? MOCK_NCS_HIGH : MOCK_NCS_LOW, mock_now, mock_now, 0, 0);
+}
+
+bool gpio_get(uint gpio) {
+    return (gpio == PICO_DEFAULT_SPI_CSN_PIN) ? ncs : true;
+}
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order) {
+    (void)order;
+    if (num == DMA_IRQ_0) {
+        dma_irq_handler = handler;
+    }
+}
+
+void irq_set_enabled(uint num, bool enabled) {
+    if (num == DMA_IRQ_0) {
+        dma_irq_enabled = enabled;
+    }
+}
+
+spi_hw_t *spi_get_hw(spi_inst_t *spi) {
+    (void)spi;
+    return &spi_hw;
+}
+
+uint spi_init(spi_inst_t *spi, uint baudrate) {
+    (void)spi;
+    return baudrate;
+}
+
+void spi_set_format(spi_inst_t *spi, uint bits, uint cpol, uint cpha, uint order) {
+    (void)spi;
+    (void)bits;
+    (void)cpol;
+    (void)cpha;
+    (void)order;
+}
+
+bool spi_is_busy(spi_inst_t *spi) {
+    (void)spi;
+    mock_sync();
+    return (tx_end > mock_now) || (dma_burst_active);
+}
+
+bool spi_is_readable(spi_inst_t *spi) {
+    (void)spi;
+    mock_sync();
+    if ((rx_count == 0) || (rx_fifo[0].ready > mock_now)) {
+        return false;
+    }
+
+    spi_hw.dr = 0x100 | rx_fifo[0].value;
+    rx_count--;
+    memmove(&rx_fifo[0], &rx_fifo[1], rx_count * sizeof(rx_fifo[0]));
+    return true;
+}
+
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len) {
+    (void)spi;
+    mock_sync();
+    for (size_t i = 0; i < len; i++) {
+        spi_transfer(src[i], mock_now, false);
+    }
+    busy_wait_us(tx_end - mock_now);
+    return len;
+}
+
+int spi_read_blocking(spi_inst_t *spi, uint8_t tx, uint8_t *dst, size_t len) {
+    (void)spi;
+    mock_sync();
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = spi_transfer(tx, mock_now, false);
+        busy_wait_us(tx_end - mock_now);
+    }
+    return len;
+}
+
+uint spi_get_dreq(spi_inst_t *spi, bool is_tx) {
+    (void)spi;
+    return is_tx ? DREQ_SPI0_TX : DREQ_SPI0_RX;
+}
+
+uint32_t clock_get_hz(enum clock_index clk) {
+    (void)clk;
+    return CLK_SYS_HZ;
+}
+
+int hardware_alarm_claim_unused(bool required) {
+    (void)required;
+    return alarms_claimed++;
+}
+
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback) {
+    (void)alarm_num;
+    alarm_callback = callback;
+}
+
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t) {
+    (void)alarm_num;
+    mock_sync();
+    if (t <= mock_now) {
+        alarm_armed = false;
+        return true;
+    }
+    alarm_target = t;
+    alarm_armed = true;
+    return false;
+}
+
+void hardware_alarm_force_irq(uint alarm_num) {
+    (void)alarm_num;
+    alarm_forced = true;
+}
+
+int dma_claim_unused_channel(bool required) {
+    (void)required;
+    return dma_claimed++;
+}
+
+int dma_claim_unused_timer(bool required) {
+    (void)required;
+    return 0;
+}
+
+void dma_timer_set_fraction(uint timer, uint16_t numerator, uint16_t denominator) {
+    (void)timer;
+    dma_timer_num = numerator;
+    dma_timer_den = denominator;
+}
+
+uint dma_get_timer_dreq(uint timer) {
+    return DREQ_DMA_TIMER0 + timer;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    (void)channel;
+    return (dma_channel_config){ .dreq = 0 };
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+    (void)c;
+    (void)size;
+}
+
+void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+    (void)c;
+    (void)incr;
+}
+
+void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+    (void)c;
+    (void)incr;
+}
+
+void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+    c->dreq = dreq;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *c, volatile void *write_addr,
+                           const volatile void *read_addr, uint count, bool trigger) {
+    dma[channel].dreq = c->dreq;
+    dma[channel].write_addr = write_addr;
+    dma[channel].read_addr = read_addr;
+    dma[channel].count = count;
+    if (trigger) {
+        dma_start_channel_mask(1u << channel);
+    }
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *addr, bool trigger) {
+    dma[channel].read_addr = addr;
+    if (trigger) {
+        dma_start_channel_mask(1u << channel);
+    }
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void *addr, bool trigger) {
+    dma[channel].write_addr = addr;
+    if (trigger) {
+        dma_start_channel_mask(1u << channel);
+    }
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t count, bool trigger) {
+    dma[channel].count = count;
+    if (trigger) {
+        dma_start_channel_mask(1u << channel);
+    }
+}
+
+static void dma_start_load(uint channel) {
+    // timer paced transfer into the TX FIFO, received data is dropped
+    uint64_t period = ((uint64_t)dma_timer_den * 1000000) / ((uint64_t)dma_timer_num * CLK_SYS_HZ);
+    const uint8_t *src = (const uint8_t *)dma[channel].read_addr;
+    for (uint32_t i = 0; i < dma[channel].count; i++) {
+        spi_transfer(src[i], mock_now + (i * period), false);
+    }
+    dma_load_end = mock_now + ((dma[channel].count - 1) * period);
+}
+
+void dma_start_channel_mask(uint32_t mask) {
+    mock_sync();
+
+    int rx = -1, tx = -1;
+    for (uint i = 0; i < DMA_CHANNELS; i++) {
+        if (!(mask & (1u << i))) {
+            continue;
+        }
+        if (dma[i].dreq == DREQ_SPI0_RX) {
+            rx = i;
+        } else if (dma[i].dreq == DREQ_SPI0_TX) {
+            tx = i;
+        } else if (dma[i].dreq >= DREQ_DMA_TIMER0) {
+            dma_start_load(i);
+        }
+    }
+
+    if ((rx >= 0) && (tx >= 0)) {
+        // bytes are simulated all at once when the transfer is complete
+        dma_burst_active = true;
+        dma_burst_rx = rx;
+        dma_burst_end = MAX(mock_now, tx_end) + (dma[rx].count * MOCK_T_BYTE);
+    }
+}
+
+bool dma_channel_is_busy(uint channel) {
+    mock_sync();
+    if ((int)channel == dma_burst_rx) {
+        return dma_burst_active;
+    }
+    return dma_load_end > mock_now;
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled) {
+    dma[channel].irq0_enabled = enabled;
+}
+
+bool dma_channel_get_irq0_status(uint channel) {
+    return dma[channel].irq0_status;
+}
+
+void dma_channel_acknowledge_irq0(uint channel) {
+    dma[channel].irq0_status = false;
+}
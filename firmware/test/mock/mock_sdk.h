@@ -0,0 +1,66 @@
+/*
+ * mock_sdk.h
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MOCK_SDK_H__
+#define __MOCK_SDK_H__
+
+/*
+ * Simulated RP2040 peripherals and PMW3360 sensor for host tests.
+ *
+ * Time only moves forward in tight_loop_contents(), busy_wait_us()
+ * and mock_run_us(). Alarm and DMA interrupts fire from there, but
+ * never while another one is being handled.
+ *
+ * The SPI runs at 2MHz, so each byte is 4us on the wire.
+ * Every byte and every change of NCS is recorded with its time.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MOCK_T_BYTE 4
+#define MOCK_BURST_SIZE 12
+
+enum mock_event_type {
+    MOCK_NCS_LOW = 0,
+    MOCK_NCS_HIGH,
+    MOCK_BYTE,
+};
+
+struct mock_event {
+    enum mock_event_type type;
+    uint64_t start, end; // equal for NCS changes
+    uint8_t mosi, miso;
+};
+
+extern uint64_t mock_now;
+
+// simulated sensor
+extern uint8_t mock_regs[0x80];
+extern uint8_t mock_burst[MOCK_BURST_SIZE];
+extern bool mock_burst_mode;
+extern uint32_t mock_burst_errors; // Motion_Burst read outside of burst mode
+
+void mock_log_clear(void);
+size_t mock_log(const struct mock_event **events);
+
+// advance time, firing interrupts as they become due
+void mock_run_us(uint64_t us);
+
+#endif // __MOCK_SDK_H__
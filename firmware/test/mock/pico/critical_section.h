@@ -0,0 +1,39 @@
+/*
+ * critical_section.h
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MOCK_PICO_CRITICAL_SECTION_H__
+#define __MOCK_PICO_CRITICAL_SECTION_H__
+
+// the host tests are single threaded
+typedef struct {
+    int depth;
+} critical_section_t;
+
+static inline void critical_section_init(critical_section_t *cs) {
+    cs->depth = 0;
+}
+
+static inline void critical_section_enter_blocking(critical_section_t *cs) {
+    cs->depth++;
+}
+
+static inline void critical_section_exit(critical_section_t *cs) {
+    cs->depth--;
+}
+
+#endif // __MOCK_PICO_CRITICAL_SECTION_H__
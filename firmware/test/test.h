@@ -0,0 +1,52 @@
+/*
+ * test.h
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TEST_H__
+#define __TEST_H__
+
+#include <stdio.h>
+
+extern unsigned int test_failures;
+
+#define CHECK(c) do {                                                   \
+    if (!(c)) {                                                         \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #c);    \
+        test_failures++;                                                \
+    }                                                                   \
+} while (0)
+
+#define CHECK_GE(a, b, what) do {                                       \
+    long long _a = (a), _b = (b);                                       \
+    if (_a < _b) {                                                      \
+        printf("%s:%d: %s: %lld < %lld\n", __FILE__, __LINE__,          \
+               what, _a, _b);                                           \
+        test_failures++;                                                \
+    }                                                                   \
+} while (0)
+
+#define TEST_DEFINE unsigned int test_failures = 0
+
+static inline int test_result(void) {
+    if (test_failures > 0) {
+        printf("%u check(s) failed\n", test_failures);
+        return 1;
+    }
+    return 0;
+}
+
+#endif // __TEST_H__
@@ -0,0 +1,465 @@
+/*
+ * test_buttons_pio.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "pico/stdlib.h"
+
+#include "config.h"
+#include "test.h"
+
+TEST_DEFINE;
+
+/*
+ * Runs src/buttons.pio cycle by cycle, with the configuration of
+ * button_scan_program_init(). Only the instructions it uses are
+ * understood, anything else fails the test.
+ */
+
+#define PROGRAM_MAX 32
+#define FIFO_SIZE 8 // RX joined
+#define PUSHES_MAX 64
+#define CLK_SYS_HZ 125000000.0
+#define DELAY_US (DEBOUNCE_DELAY_MS * 1000)
+
+// the initial state is pushed at start, with its own hold-off
+#define T0 (2 * DELAY_US)
+
+enum op {
+    OP_MOV,
+    OP_IN_PINS,
+    OP_JMP,
+    OP_JMP_X_NE_Y,
+    OP_JMP_NOT_OSRE,
+    OP_PUSH_NOBLOCK,
+    OP_OUT_NULL,
+};
+
+enum reg {
+    REG_NULL,
+    REG_X,
+    REG_Y,
+    REG_ISR,
+    REG_OSR,
+};
+
+struct instr {
+    enum op op;
+    enum reg dst, src;
+    unsigned int count;
+    char target[32];
+    unsigned int jump;
+    unsigned int delay;
+};
+
+static struct instr program[PROGRAM_MAX];
+static unsigned int length = 0, wrap_target = 0, wrap = 0, sample_in = 0;
+static unsigned int holdoff_loops = 0, holdoff_cycles = 0;
+
+static struct {
+    char name[32];
+    unsigned int addr;
+} labels[PROGRAM_MAX];
+static unsigned int label_count = 0;
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+    char *e = s + strlen(s);
+    while ((e > s) && isspace((unsigned char)e[-1])) {
+        *--e = '\0';
+    }
+    return s;
+}
+
+static enum reg parse_reg(const char *s) {
+    if (strcmp(s, "x") == 0) {
+        return REG_X;
+    } else if (strcmp(s, "y") == 0) {
+        return REG_Y;
+    } else if (strcmp(s, "isr") == 0) {
+        return REG_ISR;
+    } else if (strcmp(s, "osr") == 0) {
+        return REG_OSR;
+    } else if (strcmp(s, "null") != 0) {
+        printf("unsupported register \"%s\"\n", s);
+        test_failures++;
+    }
+    return REG_NULL;
+}
+
+static void parse_instr(char *line) {
+    struct instr *in = &program[length];
+    memset(in, 0, sizeof(*in));
+
+    char *d = strchr(line, '[');
+    if (d) {
+        in->delay = strtoul(d + 1, NULL, 10);
+        *d = '\0';
+    }
+    line = trim(line);
+
+    char a[32] = "", b[32] = "", c[32] = "";
+    sscanf(line, "%31s %31[^, ] , %31s", a, b, c);
+
+    if (strcmp(a, "mov") == 0) {
+        in->op = OP_MOV;
+        in->dst = parse_reg(b);
+        in->src = parse_reg(c);
+    } else if ((strcmp(a, "in") == 0) && (strcmp(b, "pins") == 0)) {
+        in->op = OP_IN_PINS;
+        in->count = strtoul(c, NULL, 10);
+    } else if ((strcmp(a, "out") == 0) && (strcmp(b, "null") == 0)) {
+        in->op = OP_OUT_NULL;
+        in->count = strtoul(c, NULL, 10);
+    } else if ((strcmp(a, "push") == 0) && (strcmp(b, "noblock") == 0)) {
+        in->op = OP_PUSH_NOBLOCK;
+    } else if (strcmp(a, "jmp") == 0) {
+        sscanf(line, "jmp %31s %31s", b, c);
+        if (strlen(c) == 0) {
+            in->op = OP_JMP;
+            strcpy(in->target, b);
+        } else if (strcmp(b, "x!=y") == 0) {
+            in->op = OP_JMP_X_NE_Y;
+            strcpy(in->target, c);
+        } else if (strcmp(b, "!osre") == 0) {
+            in->op = OP_JMP_NOT_OSRE;
+            strcpy(in->target, c);
+        } else {
+            printf("unsupported jump \"%s\"\n", line);
+            test_failures++;
+        }
+    } else {
+        printf("unsupported instruction \"%s\"\n", line);
+        test_failures++;
+    }
+
+    length++;
+}
+
+static bool load_program(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        printf("can not open %s\n", path);
+        return false;
+    }
+
+    char buff[256];
+    bool code = false;
+    while (fgets(buff, sizeof(buff), f)) {
+        unsigned int loops, per_loop;
+        if (sscanf(buff, "#define BUTTON_SCAN_HOLDOFF_LOOPS %u", &loops) == 1) {
+            holdoff_loops = loops;
+        } else if (sscanf(buff, "#define BUTTON_SCAN_HOLDOFF_CYCLES (BUTTON_SCAN_HOLDOFF_LOOPS * %u)", &per_loop) == 1) {
+            holdoff_cycles = holdoff_loops * per_loop;
+        }
+
+        char *c = strchr(buff, ';');
+        if (c) {
+            *c = '\0';
+        }
+        char *line = trim(buff);
+
+        if (strncmp(line, ".program", 8) == 0) {
+            code = true;
+            continue;
+        } else if (line[0] == '%') {
+            code = false;
+        }
+        if (!code || (strlen(line) == 0)) {
+            continue;
+        }
+
+        if (strcmp(line, ".wrap_target") == 0) {
+            wrap_target = length;
+        } else if (strcmp(line, ".wrap") == 0) {
+            wrap = length - 1;
+        } else if (line[strlen(line) - 1] == ':') {
+            line[strlen(line) - 1] = '\0';
+            bool pub = (strncmp(line, "public ", 7) == 0);
+            if (pub) {
+                line = trim(line + 7);
+            }
+            if (strcmp(line, "sample_in") == 0) {
+                sample_in = length;
+            }
+            strcpy(labels[label_count].name, line);
+            labels[label_count].addr = length;
+            label_count++;
+        } else if (length < PROGRAM_MAX) {
+            parse_instr(line);
+        }
+    }
+    fclose(f);
+
+    for (unsigned int i = 0; i < length; i++) {
+        if ((program[i].op != OP_JMP) && (program[i].op != OP_JMP_X_NE_Y)
+                && (program[i].op != OP_JMP_NOT_OSRE)) {
+            continue;
+        }
+        bool found = false;
+        for (unsigned int l = 0; l < label_count; l++) {
+            if (strcmp(labels[l].name, program[i].target) == 0) {
+                program[i].jump = labels[l].addr;
+                found = true;
+            }
+        }
+        if (!found) {
+            printf("unknown label \"%s\"\n", program[i].target);
+            return false;
+        }
+    }
+
+    return (length > 0) && (holdoff_loops > 0) && (holdoff_cycles > 0);
+}
+
+// level of each pin over time, pins are pulled up and pressed is low
+struct trace {
+    unsigned int pin;
+    double time_us;
+    bool pressed;
+};
+
+struct push {
+    double time_us;
+    uint32_t pins;
+};
+
+struct sim {
+    uint32_t x, y, isr, osr;
+    unsigned int isr_count, osr_count;
+    unsigned int pc;
+    struct push pushes[PUSHES_MAX];
+    unsigned int push_count;
+};
+
+static uint32_t pin_levels(const struct trace *t, size_t n, unsigned int pins, double time_us) {
+    uint32_t levels = (1u << pins) - 1;
+    for (size_t i = 0; (i < n) && (t[i].time_us <= time_us); i++) {
+        if (t[i].pressed) {
+            levels &= ~(1u << t[i].pin);
+        } else {
+            levels |= 1u << t[i].pin;
+        }
+    }
+    return levels;
+}
+
+static uint32_t reg_read(struct sim *s, enum reg r) {
+    switch (r) {
+    case REG_X: return s->x;
+    case REG_Y: return s->y;
+    case REG_ISR: return s->isr;
+    case REG_OSR: return s->osr;
+    default: return 0;
+    }
+}
+
+static void simulate(struct sim *s, const struct trace *t, size_t n,
+                     unsigned int pins, double end_us) {
+    // same clock divider as buttons_pio_add_group()
+    double div = CLK_SYS_HZ * DELAY_US / (holdoff_cycles * 1000000.0);
+    double cycle_us = div * 1000000.0 / CLK_SYS_HZ;
+
+    memset(s, 0, sizeof(*s));
+    double now = 0;
+
+    while (now < end_us) {
+        const struct instr *in = &program[s->pc];
+        unsigned int next = (s->pc == wrap) ? wrap_target : (s->pc + 1);
+        unsigned int count = (s->pc == sample_in) ? pins : in->count;
+
+        switch (in->op) {
+        case OP_MOV: {
+            uint32_t v = reg_read(s, in->src);
+            if (in->dst == REG_X) {
+                s->x = v;
+            } else if (in->dst == REG_Y) {
+                s->y = v;
+            } else if (in->dst == REG_ISR) {
+                s->isr = v;
+                s->isr_count = 0;
+            } else if (in->dst == REG_OSR) {
+                s->osr = v;
+                s->osr_count = 0;
+            }
+            break;
+        }
+
+        case OP_IN_PINS: {
+            uint32_t mask = (count >= 32) ? UINT32_MAX : ((1u << count) - 1);
+            uint32_t v = pin_levels(t, n, pins, now) & mask;
+            s->isr = (count >= 32) ? v : ((s->isr << count) | v);
+            s->isr_count = MIN(s->isr_count + count, 32);
+            break;
+        }
+
+        case OP_PUSH_NOBLOCK:
+            if (s->push_count < PUSHES_MAX) {
+                s->pushes[s->push_count].time_us = now;
+                s->pushes[s->push_count].pins = s->isr;
+                s->push_count++;
+            }
+            s->isr = 0;
+            s->isr_count = 0;
+            break;
+
+        case OP_OUT_NULL:
+            s->osr = (count >= 32) ? 0 : (s->osr >> count);
+            s->osr_count = MIN(s->osr_count + count, 32);
+            break;
+
+        case OP_JMP:
+            next = in->jump;
+            break;
+
+        case OP_JMP_X_NE_Y:
+            if (s->x != s->y) {
+                next = in->jump;
+            }
+            break;
+
+        case OP_JMP_NOT_OSRE:
+            if (s->osr_count < holdoff_loops) {
+                next = in->jump;
+            }
+            break;
+        }
+
+        s->pc = next;
+        now += (1 + in->delay) * cycle_us;
+    }
+}
+
+// one pass of the sample loop, a change is pushed within two of them
+static double sample_period_us(void) {
+    double div = CLK_SYS_HZ * DELAY_US / (holdoff_cycles * 1000000.0);
+    double cycle_us = div * 1000000.0 / CLK_SYS_HZ;
+
+    unsigned int cycles = 0;
+    for (unsigned int i = wrap_target; i < length; i++) {
+        if (program[i].op == OP_PUSH_NOBLOCK) {
+            break;
+        }
+        cycles += 1 + program[i].delay;
+    }
+    return cycles * cycle_us;
+}
+
+// press of pin 0 bouncing for 800us, release 50ms later bouncing for 900us
+static const struct trace bouncy_click[] = {
+    { 0, T0 + 1000, true }, { 0, T0 + 1100, false }, { 0, T0 + 1300, true }, { 0, T0 + 1600, false }, { 0, T0 + 1800, true },
+    { 0, T0 + 50000, false }, { 0, T0 + 50200, true }, { 0, T0 + 50300, false }, { 0, T0 + 50900, true }, { 0, T0 + 50950, false },
+};
+
+static void check_push(const struct sim *s, unsigned int i, uint32_t pins,
+                       double min_us, double max_us) {
+    CHECK(s->push_count > i);
+    if (s->push_count <= i) {
+        return;
+    }
+    CHECK(s->pushes[i].pins == pins);
+    CHECK_GE(s->pushes[i].time_us, min_us, "pushed too early");
+    CHECK_GE(max_us, s->pushes[i].time_us, "pushed too late");
+}
+
+static void test_holdoff_length(void) {
+    // the hold-off loop has to take the debounce time
+    unsigned int cycles = 0;
+    bool in_holdoff = false;
+    unsigned int loop_start = 0;
+    for (unsigned int i = 0; i < length; i++) {
+        if (program[i].op == OP_OUT_NULL) {
+            in_holdoff = true;
+            loop_start = i;
+        }
+        if (in_holdoff) {
+            cycles += 1 + program[i].delay;
+        }
+        if (in_holdoff && (program[i].op == OP_JMP_NOT_OSRE)) {
+            CHECK(program[i].jump == loop_start);
+            break;
+        }
+    }
+    CHECK(cycles * holdoff_loops == holdoff_cycles);
+}
+
+static void test_bouncy_click(void) {
+    struct sim s;
+    double period = sample_period_us();
+    simulate(&s, bouncy_click, count_of(bouncy_click), 2, T0 + 60000);
+
+    // initial state, then exactly one press and one release
+    CHECK(s.push_count == 3);
+    check_push(&s, 0, 0x3, 0, period);
+    check_push(&s, 1, 0x2, T0 + 1000, T0 + 1000 + (2 * period));
+    check_push(&s, 2, 0x3, T0 + 50000, T0 + 50000 + (2 * period));
+
+    // nothing is sampled during the hold-off
+    for (unsigned int i = 1; i < s.push_count; i++) {
+        CHECK_GE(s.pushes[i].time_us - s.pushes[i - 1].time_us, DELAY_US, "push during hold-off");
+    }
+}
+
+static void test_short_tap(void) {
+    // released during the hold-off, sampled again when it ends
+    static const struct trace tap[] = {
+        { 0, T0 + 1000, true }, { 0, T0 + 1000 + (DELAY_US / 2), false },
+    };
+
+    struct sim s;
+    double period = sample_period_us();
+    simulate(&s, tap, count_of(tap), 1, T0 + 20000);
+
+    CHECK(s.push_count == 3);
+    check_push(&s, 1, 0x0, T0 + 1000, T0 + 1000 + (2 * period));
+    check_push(&s, 2, 0x1, T0 + 1000 + DELAY_US, T0 + 1000 + DELAY_US + (3 * period));
+}
+
+static void test_group_holdoff(void) {
+    // the hold-off is shared, pin 1 pressed during it is picked up afterwards
+    static const struct trace both[] = {
+        { 0, T0 + 1000, true }, { 1, T0 + 2000, true }, { 1, T0 + 30000, false }, { 0, T0 + 40000, false },
+    };
+
+    struct sim s;
+    double period = sample_period_us();
+    simulate(&s, both, count_of(both), 2, T0 + 60000);
+
+    CHECK(s.push_count == 5);
+    check_push(&s, 1, 0x2, T0 + 1000, T0 + 1000 + (2 * period));
+    check_push(&s, 2, 0x0, T0 + 1000 + DELAY_US, T0 + 1000 + DELAY_US + (3 * period));
+    check_push(&s, 3, 0x2, T0 + 30000, T0 + 30000 + (2 * period));
+    check_push(&s, 4, 0x3, T0 + 40000, T0 + 40000 + (2 * period));
+}
+
+int main(void) {
+    if (!load_program(BUTTONS_PIO_FILE)) {
+        printf("error loading %s\n", BUTTONS_PIO_FILE);
+        return 1;
+    }
+
+    test_holdoff_length();
+    test_bouncy_click();
+    test_short_tap();
+    test_group_holdoff();
+    return test_result();
+}
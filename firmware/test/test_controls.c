@@ -0,0 +1,297 @@
+/*
+ * test_controls.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "config.h"
+#include "log.h"
+#include "pmw3360.h"
+#include "latency.h"
+#include "settings.h"
+#include "controls.h"
+#include "mock_sdk.h"
+#include "test.h"
+
+TEST_DEFINE;
+
+#define SAMPLES_MAX 64
+
+static struct pmw_sample samples[SAMPLES_MAX];
+static size_t sample_count = 0, sample_pos = 0;
+static struct settings settings;
+
+void debug_log(bool log, const char *format, ...) {
+    (void)log;
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+bool pmw_get_sample(struct pmw_sample *sample) {
+    if (sample_pos >= sample_count) {
+        sample_pos = sample_count = 0;
+        return false;
+    }
+    *sample = samples[sample_pos++];
+    return true;
+}
+
+void pmw_set_sensitivity(uint8_t sens) {
+    (void)sens;
+}
+
+uint16_t pmw_get_cpi(void) {
+    return 5000;
+}
+
+void latency_add(enum latency_stage stage, uint64_t irq_time_us) {
+    (void)stage;
+    (void)irq_time_us;
+}
+
+struct settings *settings_get(void) {
+    return &settings;
+}
+
+static void add_sample(int32_t dx, int32_t dy) {
+    if (sample_count < SAMPLES_MAX) {
+        samples[sample_count++] = (struct pmw_sample){
+            .time_us = time_us_64(),
+            .delta_x = dx,
+            .delta_y = dy,
+        };
+    }
+}
+
+// reads reports until everything was handed out, returns how many
+static int read_all(int64_t *sum_x, int64_t *sum_y, int32_t limit) {
+    int reports = 0;
+    while (true) {
+        struct mouse_state m = controls_mouse_read();
+        CHECK_GE(limit, abs(m.delta_x), "delta x above report range");
+        CHECK_GE(limit, abs(m.delta_y), "delta y above report range");
+        if ((m.delta_x == 0) && (m.delta_y == 0)) {
+            CHECK(!m.changed);
+            break;
+        }
+        CHECK(m.changed);
+        *sum_x += m.delta_x;
+        *sum_y += m.delta_y;
+        reports++;
+        mock_run_us(1000);
+    }
+    return reports;
+}
+
+static void test_large_deltas(int32_t limit) {
+    controls_init();
+    controls_set_delta_max(limit);
+
+    // up to 16bit per sensor sample, at 12000cpi
+    static const int32_t dx[] = { 32767, -32768, 1000, 127, 128, -129, 5, 30000 };
+    static const int32_t dy[] = { -32768, 32767, -1000, -128, 300, 0, -7, 12345 };
+    int64_t in_x = 0, in_y = 0, out_x = 0, out_y = 0;
+
+    for (size_t i = 0; i < sizeof(dx) / sizeof(dx[0]); i++) {
+        add_sample(dx[i], dy[i]);
+        in_x += dx[i];
+        in_y += dy[i];
+
+        // sometimes more samples arrive before the next report
+        if (i & 1) {
+            read_all(&out_x, &out_y, limit);
+        }
+    }
+    read_all(&out_x, &out_y, limit);
+
+    CHECK(in_x == out_x);
+    CHECK(in_y == out_y);
+}
+
+static void test_report_count(void) {
+    controls_init();
+    controls_set_delta_max(MOUSE_DELTA_MAX_8BIT);
+
+    // 1000 counts need ceil(1000 / 127) = 8 reports
+    int64_t x = 0, y = 0;
+    add_sample(1000, -1000);
+    CHECK(read_all(&x, &y, MOUSE_DELTA_MAX_8BIT) == 8);
+    CHECK((x == 1000) && (y == -1000));
+}
+
+static void map(int l, int id, enum button_action_type type, uint8_t arg) {
+    CHECK(controls_set_action(l, id, (struct button_action){ .type = type, .arg = arg }) == 0);
+}
+
+static bool mouse_button(int id, bool state, enum mouse_buttons button) {
+    controls_mouse_new(id, state, time_us_32());
+    return controls_mouse_read().button[button];
+}
+
+static void test_layers(void) {
+    memset(&settings, 0, sizeof(settings));
+    controls_init();
+
+    map(0, 0, ACTION_LAYER, 1);
+    map(0, 1, ACTION_LAYER, 2);
+    map(1, 1, ACTION_LAYER, 2);
+    map(0, 2, ACTION_MOUSE, MOUSE_LEFT);
+    map(1, 2, ACTION_MOUSE, MOUSE_RIGHT);
+    map(2, 2, ACTION_MOUSE, MOUSE_BACK);
+    map(0, 3, ACTION_MOUSE, MOUSE_FORWARD);
+    map(2, 3, ACTION_DISABLED, 0);
+
+    // layer 1 while held, the release follows the press
+    controls_mouse_new(0, true, time_us_32());
+    CHECK(mouse_button(2, true, MOUSE_RIGHT));
+    controls_mouse_new(0, false, time_us_32());
+    CHECK(!mouse_button(2, false, MOUSE_RIGHT));
+
+    // releasing one of two held layer keys keeps the other layer
+    controls_mouse_new(0, true, time_us_32());
+    controls_mouse_new(1, true, time_us_32());
+    CHECK(mouse_button(2, true, MOUSE_BACK));
+    CHECK(!mouse_button(2, false, MOUSE_BACK));
+    controls_mouse_new(1, false, time_us_32());
+    CHECK(mouse_button(2, true, MOUSE_RIGHT));
+    CHECK(!mouse_button(2, false, MOUSE_RIGHT));
+    controls_mouse_new(0, false, time_us_32());
+    CHECK(mouse_button(2, true, MOUSE_LEFT));
+    CHECK(!mouse_button(2, false, MOUSE_LEFT));
+
+    // none falls back to layer 0, disabled does not
+    controls_mouse_new(0, true, time_us_32());
+    CHECK(mouse_button(3, true, MOUSE_FORWARD));
+    CHECK(!mouse_button(3, false, MOUSE_FORWARD));
+    controls_mouse_new(0, false, time_us_32());
+    controls_mouse_new(1, true, time_us_32());
+    CHECK(!mouse_button(3, true, MOUSE_FORWARD));
+    controls_mouse_new(3, false, time_us_32());
+    controls_mouse_new(1, false, time_us_32());
+
+    struct button_action action;
+    CHECK((controls_action_parse("disabled", &action) == 0) && (action.type == ACTION_DISABLED));
+    CHECK((controls_action_parse("layer 3", &action) == 0) && (action.type == ACTION_LAYER) && (action.arg == 3));
+    CHECK(controls_action_parse("layer 4", &action) != 0);
+}
+
+static void test_key_report(void) {
+    memset(&settings, 0, sizeof(settings));
+    settings.keymap[0][0] = (struct button_action){ .type = ACTION_KEY, .arg = 0x04 };
+    controls_init();
+
+    // keys alone need no mouse report
+    controls_mouse_new(0, true, time_us_32());
+    struct mouse_state m = controls_mouse_read();
+    CHECK(m.keys_changed && !m.changed);
+    CHECK(m.keycode[0] == 0x04);
+
+    m = controls_mouse_read();
+    CHECK(!m.keys_changed && !m.changed);
+
+    controls_mouse_new(0, false, time_us_32());
+    m = controls_mouse_read();
+    CHECK(m.keys_changed && !m.changed);
+    CHECK(m.keycode[0] == 0);
+}
+
+struct timeline {
+    uint32_t time_us; // since start of the timeline
+    int8_t button; // 1 press, -1 release of scroll-lock, 0 for motion
+    int32_t motion;
+};
+
+/*
+ * Events reach the controls at the next poll, like reports waiting for
+ * a USB frame, but carry the time they happened. Returns how many fake
+ * middle clicks the host saw.
+ */
+static int fake_middle_run(uint32_t period_us, const struct timeline *t, size_t n) {
+    memset(&settings, 0, sizeof(settings));
+    settings.keymap[0][1] = (struct button_action){ .type = ACTION_SCROLL_LOCK };
+    controls_init();
+
+    uint32_t start = time_us_32();
+    uint32_t end = t[n - 1].time_us + 100 * 1000;
+    size_t next = 0;
+    int clicks = 0;
+    bool middle = false;
+
+    for (uint32_t poll = period_us; poll <= end; poll += period_us) {
+        mock_run_us(start + poll - time_us_32());
+
+        for (; (next < n) && (t[next].time_us <= poll); next++) {
+            if (t[next].button != 0) {
+                controls_mouse_new(1, t[next].button > 0, start + t[next].time_us);
+            } else {
+                add_sample(t[next].motion, 0);
+            }
+        }
+
+        struct mouse_state m = controls_mouse_read();
+        if (m.button[MOUSE_MIDDLE] && !middle) {
+            clicks++;
+        }
+        middle = m.button[MOUSE_MIDDLE];
+    }
+
+    CHECK(!middle);
+    return clicks;
+}
+
+static void test_fake_middle_rates(void) {
+    static const struct timeline tap[] = {
+        { 500, 1, 0 },
+        { 100500, -1, 0 },
+    };
+
+    // just too long, edges at 125Hz arrive up to 8ms late
+    static const struct timeline hold[] = {
+        { 500, 1, 0 },
+        { (MOUSE_FAKE_MIDDLE_TAP_MS + 3) * 1000 + 500, -1, 0 },
+    };
+
+    // motion right before the release was not read yet
+    static const struct timeline scroll[] = {
+        { 500, 1, 0 },
+        { 99700, 0, 2 * MOUSE_FAKE_MIDDLE_MOVE_COUNTS * 5 }, // at 5000cpi
+        { 100000, -1, 0 },
+    };
+
+    CHECK(fake_middle_run(8000, tap, 2) == 1);
+    CHECK(fake_middle_run(1000, tap, 2) == 1);
+    CHECK(fake_middle_run(8000, hold, 2) == 0);
+    CHECK(fake_middle_run(1000, hold, 2) == 0);
+    CHECK(fake_middle_run(8000, scroll, 3) == 0);
+    CHECK(fake_middle_run(1000, scroll, 3) == 0);
+}
+
+int main(void) {
+    test_large_deltas(MOUSE_DELTA_MAX_8BIT);
+    test_large_deltas(MOUSE_DELTA_MAX_16BIT);
+    test_report_count();
+    test_layers();
+    test_key_report();
+    test_fake_middle_rates();
+    return test_result();
+}
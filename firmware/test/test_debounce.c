@@ -0,0 +1,209 @@
+/*
+ * test_debounce.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include "pico/stdlib.h"
+
+#include "config.h"
+#include "debounce.h"
+#include "test.h"
+
+TEST_DEFINE;
+
+#define DELAY_US (DEBOUNCE_DELAY_MS * 1000)
+#define REPORTS_MAX 16
+
+struct edge {
+    uint32_t time;
+    bool state;
+};
+
+struct report {
+    uint32_t time;
+    bool state;
+};
+
+struct result {
+    struct report reports[REPORTS_MAX];
+    size_t count;
+    uint32_t bounce[REPORTS_MAX];
+    size_t bounce_count;
+};
+
+static void poll(struct debounce *d, enum button_debounce mode, uint32_t now,
+                 bool *pending, uint32_t *due, struct result *res) {
+    enum debounce_result r;
+    uint32_t bounce;
+    uint32_t wait = debounce_poll(d, mode, now, &r, &bounce);
+
+    if ((r == DEBOUNCE_REPORT) && (res->count < REPORTS_MAX)) {
+        res->reports[res->count++] = (struct report){ .time = now, .state = d->current };
+    }
+    if ((bounce != UINT32_MAX) && (res->bounce_count < REPORTS_MAX)) {
+        res->bounce[res->bounce_count++] = bounce;
+    }
+
+    *pending = (wait != UINT32_MAX);
+    *due = now + wait;
+}
+
+// feeds edges like buttons_run(), polling again exactly when asked to
+static struct result replay(enum button_debounce mode, const struct edge *edges, size_t n) {
+    struct result res = { .count = 0, .bounce_count = 0 };
+    struct debounce d;
+    debounce_init(&d, false, 0);
+
+    bool pending = false;
+    uint32_t due = 0;
+    size_t i = 0;
+
+    while ((i < n) || pending) {
+        // timestamps wrap around, like time_us_32()
+        if (pending && ((i >= n) || ((int32_t)(due - edges[i].time) < 0))) {
+            poll(&d, mode, due, &pending, &due, &res);
+            continue;
+        }
+
+        enum debounce_result r = debounce_edge(&d, mode, edges[i].state, edges[i].time);
+        if ((r == DEBOUNCE_REPORT) && (res.count < REPORTS_MAX)) {
+            res.reports[res.count++] = (struct report){ .time = edges[i].time, .state = d.current };
+        }
+        poll(&d, mode, edges[i].time, &pending, &due, &res);
+        i++;
+    }
+
+    return res;
+}
+
+// press bouncing for 800us, released 50ms later bouncing for 900us
+static const struct edge bouncy_click[] = {
+    { 1000, true }, { 1100, false }, { 1300, true }, { 1600, false }, { 1800, true },
+    { 50000, false }, { 50200, true }, { 50300, false }, { 50900, true }, { 50900, false },
+};
+
+// clean press and release, without any bounce
+static const struct edge clean_click[] = {
+    { 1000, true }, { 30000, false },
+};
+
+// release shorter than the debounce delay, while held
+static const struct edge glitch[] = {
+    { 1000, true }, { 20000, false }, { 20000 + (DELAY_US / 2), true }, { 40000, false },
+};
+
+static void check_click(const struct result *res, uint32_t press_min, uint32_t press_max,
+                        uint32_t release_min, uint32_t release_max) {
+    // exactly one press and one release
+    CHECK(res->count == 2);
+    if (res->count != 2) {
+        return;
+    }
+    CHECK(res->reports[0].state);
+    CHECK(!res->reports[1].state);
+
+    CHECK_GE(res->reports[0].time, press_min, "press reported too early");
+    CHECK_GE(press_max, res->reports[0].time, "press reported too late");
+    CHECK_GE(res->reports[1].time, release_min, "release reported too early");
+    CHECK_GE(release_max, res->reports[1].time, "release reported too late");
+}
+
+static void test_bouncy_click(void) {
+    struct result eager = replay(BUTTON_DEBOUNCE_EAGER, bouncy_click, count_of(bouncy_click));
+    struct result deferred = replay(BUTTON_DEBOUNCE_DEFERRED, bouncy_click, count_of(bouncy_click));
+
+    // eager adds no latency, the first edge is reported
+    check_click(&eager, 1000, 1000, 50000, 50000);
+
+    // deferred waits until stable for the debounce delay
+    check_click(&deferred, 1800 + DELAY_US, 1800 + DELAY_US + 1, 50900 + DELAY_US, 50900 + DELAY_US + 1);
+
+    // both measure the same bounce
+    CHECK(eager.bounce_count == 2);
+    CHECK(deferred.bounce_count == 2);
+    for (size_t i = 0; (i < eager.bounce_count) && (i < deferred.bounce_count); i++) {
+        CHECK(eager.bounce[i] == deferred.bounce[i]);
+    }
+    CHECK(deferred.bounce[0] == 800);
+    CHECK(deferred.bounce[1] == 900);
+}
+
+static void test_clean_click(void) {
+    struct result eager = replay(BUTTON_DEBOUNCE_EAGER, clean_click, count_of(clean_click));
+    struct result deferred = replay(BUTTON_DEBOUNCE_DEFERRED, clean_click, count_of(clean_click));
+
+    check_click(&eager, 1000, 1000, 30000, 30000);
+    check_click(&deferred, 1000 + DELAY_US, 1000 + DELAY_US + 1, 30000 + DELAY_US, 30000 + DELAY_US + 1);
+}
+
+static void test_short_tap(void) {
+    // released during the hold-off, still has to become a click
+    static const struct edge tap[] = {
+        { 1000, true }, { 1000 + (DELAY_US / 2), false },
+    };
+
+    struct result eager = replay(BUTTON_DEBOUNCE_EAGER, tap, count_of(tap));
+    check_click(&eager, 1000, 1000, 1000 + DELAY_US, 1000 + DELAY_US + 1);
+
+    // deferred never sees it stable, so it is filtered and counted as bounce
+    struct result deferred = replay(BUTTON_DEBOUNCE_DEFERRED, tap, count_of(tap));
+    CHECK(deferred.count == 0);
+    CHECK(deferred.bounce_count == 1);
+}
+
+static void test_glitch(void) {
+    // deferred filters the short release, one click
+    struct result deferred = replay(BUTTON_DEBOUNCE_DEFERRED, glitch, count_of(glitch));
+    check_click(&deferred, 1000 + DELAY_US, 1000 + DELAY_US + 1, 40000 + DELAY_US, 40000 + DELAY_US + 1);
+
+    // eager reports the release right away, the press again after the hold-off
+    struct result eager = replay(BUTTON_DEBOUNCE_EAGER, glitch, count_of(glitch));
+    CHECK(eager.count == 4);
+    for (size_t i = 0; i < eager.count; i++) {
+        CHECK(eager.reports[i].state == !(i & 1));
+    }
+    CHECK(eager.reports[0].time == 1000);
+    CHECK(eager.reports[1].time == 20000);
+    CHECK(eager.reports[2].time == 20000 + DELAY_US + 1);
+    CHECK(eager.reports[3].time == 40000);
+}
+
+static void test_timer_wrap(void) {
+    // time_us_32() wraps after about 71 minutes
+    struct edge wrap[count_of(bouncy_click)];
+    uint32_t offset = UINT32_MAX - 20000;
+    for (size_t i = 0; i < count_of(bouncy_click); i++) {
+        wrap[i].time = bouncy_click[i].time + offset;
+        wrap[i].state = bouncy_click[i].state;
+    }
+
+    struct result eager = replay(BUTTON_DEBOUNCE_EAGER, wrap, count_of(wrap));
+    CHECK(eager.count == 2);
+    CHECK(eager.reports[0].time == wrap[0].time);
+
+    struct result deferred = replay(BUTTON_DEBOUNCE_DEFERRED, wrap, count_of(wrap));
+    CHECK(deferred.count == 2);
+    CHECK(deferred.bounce[0] == 800);
+}
+
+int main(void) {
+    test_bouncy_click();
+    test_clean_click();
+    test_short_tap();
+    test_glitch();
+    test_timer_wrap();
+    return test_result();
+}
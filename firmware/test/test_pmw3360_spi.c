@@ -0,0 +1,353 @@
+/*
+ * test_pmw3360_spi.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "pmw3360_registers.h"
+#include "pmw3360_spi.h"
+#include "mock_sdk.h"
+#include "test.h"
+
+TEST_DEFINE;
+
+// minimum delays from the datasheet, in microseconds
+#define T_SRAD 160 // read address to first data byte
+#define T_SRAD_MOTBR 35 // Motion_Burst address to first data byte
+#define T_WRITE_ADDRESS 15 // write address to data byte
+#define T_SCLK_NCS_WRITE 20 // last byte of a write to NCS high
+#define T_SWX 100 // NCS high after write to next access
+#define T_SRX 20 // last byte of a read to next access
+#define T_BEXIT 1 // NCS high after burst to next NCS low
+#define T_LOAD 15 // between bytes of a SROM download
+
+struct transaction {
+    uint64_t low, high;
+    const struct mock_event *bytes;
+    size_t count;
+};
+
+static size_t split_transactions(struct transaction *t, size_t max) {
+    const struct mock_event *e;
+    size_t n = mock_log(&e);
+    size_t count = 0;
+    uint64_t last = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        CHECK_GE(e[i].start, last, "events out of order");
+        last = e[i].start;
+
+        if (e[i].type == MOCK_NCS_LOW) {
+            if (count >= max) {
+                break;
+            }
+            t[count].low = e[i].start;
+            t[count].high = 0;
+            t[count].bytes = &e[i + 1];
+            t[count].count = 0;
+            count++;
+        } else if (e[i].type == MOCK_NCS_HIGH) {
+            CHECK(count > 0);
+            t[count - 1].high = e[i].start;
+        } else {
+            CHECK((count > 0) && (t[count - 1].high == 0)); // byte sent without NCS low
+            t[count - 1].count++;
+        }
+    }
+
+    return count;
+}
+
+static void check_transaction(const struct transaction *t, const struct transaction *next) {
+    const struct mock_event *b = t->bytes;
+    uint8_t addr = b[0].mosi;
+
+    CHECK(t->count >= 2);
+    CHECK(t->high != 0);
+    if ((t->count < 2) || (t->high == 0)) {
+        return;
+    }
+
+    CHECK_GE(b[0].start, t->low, "NCS low to first byte");
+    CHECK_GE(t->high, b[t->count - 1].end, "last byte to NCS high");
+
+    if (addr == (REG_SROM_LOAD_BURST | WRITE_BIT)) {
+        for (size_t i = 1; i < t->count; i++) {
+            CHECK_GE(b[i].start - b[i - 1].end, T_LOAD, "tLOAD between SROM bytes");
+        }
+    } else if (addr & WRITE_BIT) {
+        CHECK(t->count == 2);
+        CHECK_GE(b[1].start - b[0].end, T_WRITE_ADDRESS, "write address to data");
+    } else if (addr == REG_MOTION_BURST) {
+        CHECK(t->count == 1 + sizeof(struct pmw_motion_report));
+        CHECK_GE(b[1].start - b[0].end, T_SRAD_MOTBR, "tSRAD_MOTBR");
+    } else if (addr == REG_RAW_DATA_BURST) {
+        CHECK_GE(b[1].start - b[0].end, T_SRAD_MOTBR, "raw data burst address to data");
+    } else {
+        CHECK(t->count == 2);
+        CHECK_GE(b[1].start - b[0].end, T_SRAD, "tSRAD");
+    }
+
+    if (addr & WRITE_BIT) {
+        CHECK_GE(t->high - b[t->count - 1].end, T_SCLK_NCS_WRITE, "tSCLK-NCS write");
+    }
+
+    if (!next) {
+        return;
+    }
+
+    CHECK_GE(next->low - t->high, T_BEXIT, "NCS high time");
+    if ((next->count < 1) || (addr == REG_MOTION_BURST) || (addr == REG_RAW_DATA_BURST)) {
+        return;
+    }
+
+    if (addr & WRITE_BIT) {
+        CHECK_GE(next->bytes[0].start - t->high, T_SWX, "tSWW / tSWR");
+    } else {
+        CHECK_GE(next->bytes[0].start - b[t->count - 1].end, T_SRX, "tSRW / tSRR");
+    }
+}
+
+static void check_timing(void) {
+    static struct transaction t[256];
+    size_t n = split_transactions(t, sizeof(t) / sizeof(t[0]));
+    CHECK(n > 0);
+
+    for (size_t i = 0; i < n; i++) {
+        check_transaction(&t[i], (i + 1 < n) ? &t[i + 1] : NULL);
+    }
+}
+
+static void test_blocking_access(void) {
+    mock_log_clear();
+    mock_regs[REG_PRODUCT_ID] = 0x42;
+    for (size_t i = 0; i < MOCK_BURST_SIZE; i++) {
+        mock_burst[i] = 0x10 + i;
+    }
+
+    CHECK(pmw_read_register(REG_PRODUCT_ID) == 0x42);
+    pmw_write_register(REG_CONFIG1, 0x31);
+    CHECK(mock_regs[REG_CONFIG1] == 0x31);
+
+    struct pmw_motion_report report;
+    for (int i = 0; i < 3; i++) {
+        memset(&report, 0, sizeof(report));
+        pmw_read_motion_burst((uint8_t *)&report);
+        CHECK(memcmp(&report, mock_burst, sizeof(report)) == 0);
+    }
+
+    pmw_write_register(REG_CONFIG2, 0x20);
+    CHECK(pmw_read_register(REG_CONFIG2) == 0x20);
+    pmw_read_motion_burst((uint8_t *)&report);
+    CHECK(pmw_read_register(REG_PRODUCT_ID) == 0x42);
+
+    CHECK(mock_burst_errors == 0);
+    check_timing();
+}
+
+static void test_queued_access(void) {
+    mock_log_clear();
+
+    uint8_t buff[4][sizeof(struct pmw_motion_report)];
+    struct pmw_op ops[] = {
+        { .type = PMW_OP_MOTION_BURST, .buff = buff[0] },
+        { .type = PMW_OP_WRITE, .reg = REG_CONFIG1, .data = 0x12 },
+        { .type = PMW_OP_MOTION_BURST, .buff = buff[1] },
+        { .type = PMW_OP_MOTION_BURST, .buff = buff[2] },
+        { .type = PMW_OP_READ, .reg = REG_CONFIG1 },
+        { .type = PMW_OP_READ, .reg = REG_PRODUCT_ID },
+        { .type = PMW_OP_MOTION_BURST, .buff = buff[3] },
+        { .type = PMW_OP_WRITE, .reg = REG_CONFIG1, .data = 0x34 },
+    };
+    size_t n = sizeof(ops) / sizeof(ops[0]);
+
+    for (size_t i = 0; i < n; i++) {
+        CHECK(pmw_spi_submit(&ops[i]));
+    }
+    for (size_t i = 0; i < n; i++) {
+        pmw_spi_wait(&ops[i]);
+    }
+    pmw_spi_wait_idle();
+    mock_run_us(1000);
+
+    CHECK(ops[4].data == 0x12);
+    CHECK(ops[5].data == 0x42);
+    CHECK(mock_regs[REG_CONFIG1] == 0x34);
+    for (size_t i = 0; i < 4; i++) {
+        CHECK(memcmp(buff[i], mock_burst, sizeof(buff[i])) == 0);
+    }
+
+    CHECK(mock_burst_errors == 0);
+    check_timing();
+}
+
+static void test_srom_download(void) {
+    mock_log_clear();
+
+    uint8_t srom[32];
+    for (size_t i = 0; i < sizeof(srom); i++) {
+        srom[i] = i ^ 0xA5;
+    }
+
+    pmw_write_register(REG_CONFIG2, 0x00);
+    pmw_write_register(REG_SROM_ENABLE, 0x18);
+    pmw_write_register_burst(REG_SROM_LOAD_BURST, srom, sizeof(srom));
+    CHECK(pmw_read_register(REG_PRODUCT_ID) == 0x42);
+
+    const struct mock_event *e;
+    size_t n = mock_log(&e);
+    size_t sent = 0;
+    for (size_t i = 0; i < n; i++) {
+        if ((e[i].type == MOCK_BYTE) && (e[i].mosi == (REG_SROM_LOAD_BURST | WRITE_BIT))) {
+            for (size_t j = 0; (j < sizeof(srom)) && (i + 1 + j < n); j++) {
+                if (e[i + 1 + j].mosi == srom[j]) {
+                    sent++;
+                }
+            }
+        }
+    }
+    CHECK(sent == sizeof(srom));
+
+    check_timing();
+}
+
+static void test_direct_access_holds_bus(void) {
+    mock_log_clear();
+
+    uint8_t srom[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    struct pmw_op op = { .type = PMW_OP_READ, .reg = REG_PRODUCT_ID };
+
+    pmw_write_register_burst_start(REG_SROM_LOAD_BURST, srom, sizeof(srom));
+    CHECK(!pmw_spi_idle());
+    CHECK(pmw_spi_submit(&op));
+    mock_run_us(500);
+    CHECK(!op.done);
+
+    pmw_write_register_burst_finish();
+    pmw_spi_wait(&op);
+    CHECK(op.data == 0x42);
+
+    check_timing();
+}
+
+static void test_split_read_burst(void) {
+    mock_log_clear();
+
+    uint8_t frame[48];
+    struct pmw_op op = { .type = PMW_OP_READ, .reg = REG_PRODUCT_ID };
+
+    // a frame capture is read in chunks, with other work in between
+    pmw_read_register_burst_start(REG_RAW_DATA_BURST);
+    for (size_t pos = 0; pos < sizeof(frame); pos += 16) {
+        pmw_read_register_burst_continue(frame + pos, 16);
+        if (pos == 0) {
+            CHECK(pmw_spi_submit(&op));
+        }
+        mock_run_us(300);
+        CHECK(!op.done);
+    }
+    pmw_read_register_burst_finish();
+    pmw_spi_wait(&op);
+    CHECK(op.data == 0x42);
+
+    struct transaction t[4];
+    size_t n = split_transactions(t, 4);
+    CHECK(n == 2);
+    CHECK((n > 0) && (t[0].count == 1 + sizeof(frame)));
+
+    check_timing();
+}
+
+static struct pmw_op *completed[16];
+static size_t completed_count = 0;
+
+static void record_done(struct pmw_op *op) {
+    CHECK(op->done);
+    if (completed_count < 16) {
+        completed[completed_count++] = op;
+    }
+}
+
+static void test_order_and_rearm(void) {
+    mock_log_clear();
+    completed_count = 0;
+
+    // leaves burst mode
+    pmw_write_register(REG_CONFIG2, 0x00);
+    struct pmw_spi_stats before = pmw_spi_get_stats();
+
+    uint8_t buff[6][sizeof(struct pmw_motion_report)];
+    struct pmw_op ops[] = {
+        { .type = PMW_OP_MOTION_BURST, .buff = buff[0] }, // re-arms
+        { .type = PMW_OP_MOTION_BURST, .buff = buff[1] },
+        { .type = PMW_OP_READ, .reg = REG_SQUAL },
+        { .type = PMW_OP_MOTION_BURST, .buff = buff[2] }, // re-arms
+        { .type = PMW_OP_MOTION_BURST, .buff = buff[3] },
+        { .type = PMW_OP_WRITE, .reg = REG_ANGLE_TUNE, .data = 0x10 },
+        { .type = PMW_OP_MOTION_BURST, .buff = buff[4] }, // re-arms
+        { .type = PMW_OP_MOTION_BURST, .buff = buff[5] },
+    };
+    size_t n = sizeof(ops) / sizeof(ops[0]);
+
+    for (size_t i = 0; i < n; i++) {
+        ops[i].callback = record_done;
+        CHECK(pmw_spi_submit(&ops[i]));
+    }
+    pmw_spi_wait_idle();
+
+    // completed in the order they were submitted
+    CHECK(completed_count == n);
+    for (size_t i = 0; (i < completed_count) && (i < n); i++) {
+        CHECK(completed[i] == &ops[i]);
+    }
+
+    struct pmw_spi_stats after = pmw_spi_get_stats();
+    CHECK(after.ops - before.ops == n);
+    CHECK(after.rearm - before.rearm == 3);
+
+    // consecutive bursts stay armed
+    before = after;
+    for (int i = 0; i < 3; i++) {
+        pmw_read_motion_burst(buff[0]);
+    }
+    CHECK(pmw_spi_get_stats().rearm == before.rearm);
+
+    // so does direct bus access
+    uint8_t srom[4] = { 0 };
+    pmw_write_register_burst(REG_SROM_LOAD_BURST, srom, sizeof(srom));
+    pmw_read_motion_burst(buff[0]);
+    CHECK(pmw_spi_get_stats().rearm == before.rearm + 1);
+
+    // the sensor was in burst mode for every burst read
+    CHECK(mock_burst_errors == 0);
+    check_timing();
+}
+
+int main(void) {
+    pmw_spi_init();
+
+    test_blocking_access();
+    test_queued_access();
+    test_srom_download();
+    test_direct_access_holds_bus();
+    test_split_read_burst();
+    test_order_and_rearm();
+
+    return test_result();
+}
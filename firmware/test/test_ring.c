@@ -0,0 +1,61 @@
+/*
+ * test_ring.c
+ *
+ * Copyright (c) 2022 - 2023 Thomas Buck (thomas@xythobuz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * See <http://www.gnu.org/licenses/>.
+ */
+
+#include "pico/stdlib.h"
+
+#include "ring.h"
+#include "test.h"
+
+TEST_DEFINE;
+
+#define RING_SIZE 4
+
+static void test_full(void) {
+    uint32_t buff[RING_SIZE];
+    struct ring_buffer rb = RB_INIT(buff, RING_SIZE, sizeof(uint32_t));
+
+    CHECK(!rb_full(&rb));
+    for (uint32_t i = 0; i < RING_SIZE - 1; i++) {
+        CHECK(!rb_full(&rb));
+        CHECK(rb_push(&rb, &i));
+    }
+    CHECK(rb_full(&rb));
+    CHECK(rb_len(&rb) == RING_SIZE - 1);
+
+    // a full ring rejects the element, nothing is overwritten
+    uint32_t v = 42;
+    CHECK(!rb_push(&rb, &v));
+
+    CHECK(rb_pop(&rb, &v));
+    CHECK(v == 0);
+    CHECK(!rb_full(&rb));
+
+    // wrap around a few times
+    for (uint32_t i = 0; i < 3 * RING_SIZE; i++) {
+        uint32_t in = 100 + i;
+        CHECK(rb_push(&rb, &in));
+        CHECK(rb_full(&rb));
+        CHECK(rb_pop(&rb, &v));
+        CHECK(v == ((i < 2) ? i + 1 : 100 + i - 2));
+    }
+}
+
+int main(void) {
+    test_full();
+    return test_result();
+}